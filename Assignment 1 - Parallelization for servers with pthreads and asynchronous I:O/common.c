@@ -1,22 +1,138 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "common.h"
 
+#define LINE_LENGTH 128
+#define COMPACT_LENGTH 81
+
+/* Read the next non-blank line without its line ending; returns its length or -1 at EOF */
+static int read_line(FILE *inputfile, char *line) {
+    int length;
+    do {
+        if (fgets(line, LINE_LENGTH, inputfile) == NULL) {
+            return -1;
+        }
+        length = strlen(line);
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+    } while (length == 0);
+    return length;
+}
+
+/*
+ * Convert one 81 character line into p.  Dots and zeroes are blanks; returns
+ * 0 if any other character is not a digit.
+ */
+static int parse_compact(const char *line, puzzle *p) {
+    int *cells = &p->content[0][0];
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i none = _mm_setzero_si128();
+    __m128i valid = _mm_set1_epi8(-1);
+    for (; i + 16 <= COMPACT_LENGTH; i += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *) (line + i));
+        __m128i blanks = _mm_cmpeq_epi8(chars, dot);
+        __m128i digits = _mm_andnot_si128(blanks, _mm_sub_epi8(chars, zero));
+        /* Unsigned digits <= 9 is the range check for '0'..'9' */
+        valid = _mm_and_si128(valid, _mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine));
+
+        __m128i low = _mm_unpacklo_epi8(digits, none);
+        __m128i high = _mm_unpackhi_epi8(digits, none);
+        _mm_storeu_si128((__m128i *) (cells + i), _mm_unpacklo_epi16(low, none));
+        _mm_storeu_si128((__m128i *) (cells + i + 4), _mm_unpackhi_epi16(low, none));
+        _mm_storeu_si128((__m128i *) (cells + i + 8), _mm_unpacklo_epi16(high, none));
+        _mm_storeu_si128((__m128i *) (cells + i + 12), _mm_unpackhi_epi16(high, none));
+    }
+    if (_mm_movemask_epi8(valid) != 0xFFFF) {
+        return 0;
+    }
+#endif
+    for (; i < COMPACT_LENGTH; i++) {
+        if (line[i] == '.') {
+            cells[i] = 0;
+        } else if (line[i] >= '0' && line[i] <= '9') {
+            cells[i] = line[i] - '0';
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Decode the first nine cells of a row of the nine-line form; returns 0 if
+ * the line is shorter or holds anything but digits and dots there.
+ */
+static int parse_row(const char *line, int length, int *row) {
+    if (length < 9) {
+        return 0;
+    }
+    for (int j = 0; j < 9; j++) {
+        if (line[j] == '.') {
+            row[j] = 0;
+        } else if (line[j] >= '0' && line[j] <= '9') {
+            row[j] = line[j] - '0';
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 puzzle *read_next_puzzle(FILE *inputfile) {
+    char line[LINE_LENGTH];
+    int length;
     puzzle *p = malloc(sizeof(puzzle));
-    char temp[10];
-    for (int i = 0; i < 9; i++) {
-        int read = fscanf(inputfile, "%9c\n", temp);
-        if (read != 1) {
-            /* Reached EOF */
-            free(p);
-            return NULL;
+
+    while ((length = read_line(inputfile, line)) >= 0) {
+        /* One puzzle per line */
+        if (length == COMPACT_LENGTH) {
+            if (parse_compact(line, p)) {
+                return p;
+            }
+            printf("Skipping malformed puzzle line: %s\n", line);
+            continue;
+        }
+
+        /* Nine lines of nine cells; a bad row skips the whole puzzle, but
+         * its remaining rows are still read to stay in step with the file */
+        int valid = 1;
+        for (int i = 0; i < 9; i++) {
+            if (i > 0 && (length = read_line(inputfile, line)) < 0) {
+                /* Reached EOF in the middle of a puzzle */
+                free(p);
+                return NULL;
+            }
+            if (valid && !parse_row(line, length, p->content[i])) {
+                printf("Skipping malformed puzzle line: %s\n", line);
+                valid = 0;
+            }
         }
+        if (valid) {
+            return p;
+        }
+    }
+
+    /* Reached EOF */
+    free(p);
+    return NULL;
+}
+
+void write_compact(puzzle *p, FILE *outputfile) {
+    char line[COMPACT_LENGTH + 1];
+    for (int i = 0; i < 9; i++) {
         for (int j = 0; j < 9; j++) {
-            p->content[i][j] = temp[j] == '.'
-                               ? 0
-                               : temp[j] - '0';
+            line[i * 9 + j] = p->content[i][j] ? '0' + p->content[i][j] : '.';
         }
     }
-    return p;
-}
\ No newline at end of file
+    line[COMPACT_LENGTH] = '\n';
+    fwrite(line, 1, sizeof(line), outputfile);
+}
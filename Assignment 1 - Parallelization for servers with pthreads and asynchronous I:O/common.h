@@ -4,6 +4,11 @@ typedef struct {
     int content[9][9];
 } puzzle;
 
+/* Reads either nine lines of nine cells or one line of 81 cells,
+ * whichever the next puzzle in the file uses */
 puzzle *read_next_puzzle(FILE *inputfile);
 
+/* Write the puzzle as a single line of 81 cells */
+void write_compact(puzzle *p, FILE *outputfile);
+
 #endif //SUDOKU_COMMON_H
@@ -0,0 +1,64 @@
+#include "histogram.h"
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/* Exact below 2 * SUB_BUCKETS; above, the top HISTOGRAM_SUB_BITS + 1 bits
+ * of the value pick the bucket within its power of two */
+static int bucket_of(unsigned long value) {
+    if (value < 2 * SUB_BUCKETS) {
+        return value;
+    }
+    int top = 63 - __builtin_clzl(value);
+    int shift = top - HISTOGRAM_SUB_BITS;
+    int bucket = (shift + 1) * SUB_BUCKETS + (int) (value >> shift) - SUB_BUCKETS;
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+/* Largest value that falls in bucket */
+static unsigned long bucket_limit(int bucket) {
+    if (bucket < 2 * SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / SUB_BUCKETS - 1;
+    return (((unsigned long) (bucket % SUB_BUCKETS + SUB_BUCKETS + 1)) << shift) - 1;
+}
+
+void histogram_record(histogram *h, long us) {
+    unsigned long value = us > 0 ? us : 0;
+    __atomic_fetch_add(&h->counts[bucket_of(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->total, 1, __ATOMIC_RELAXED);
+
+    unsigned long max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (value > max
+           && !__atomic_compare_exchange_n(&h->max, &max, value, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+long histogram_percentile(histogram *h, double p) {
+    unsigned long total = __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+    unsigned long rank = (unsigned long) (p * total + 0.5);
+    unsigned long seen = 0;
+    if (total == 0) {
+        return 0;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            unsigned long limit = bucket_limit(i);
+            return limit < h->max ? limit : h->max;
+        }
+    }
+    return h->max;
+}
+
+void histogram_print(histogram *h, const char *name, FILE *outputfile) {
+    fprintf(outputfile, "%-8s %10.3f %10.3f %10.3f %10.3f\n", name,
+            histogram_percentile(h, 0.50) / 1e3,
+            histogram_percentile(h, 0.90) / 1e3,
+            histogram_percentile(h, 0.99) / 1e3,
+            h->max / 1e3);
+}
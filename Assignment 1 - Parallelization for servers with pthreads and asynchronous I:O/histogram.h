@@ -0,0 +1,28 @@
+#ifndef SUDOKU_HISTOGRAM_H
+#define SUDOKU_HISTOGRAM_H
+#include <stdio.h>
+
+/* 32 buckets per power of two: values below 64 are exact, larger ones are
+ * kept to within about 3%, up to 2^32 us (71 minutes) */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/* Latencies in microseconds.  Recording uses atomic adds only, so any number
+ * of threads may share one histogram without a lock */
+typedef struct {
+    unsigned long counts[HISTOGRAM_BUCKETS];
+    unsigned long total;
+    unsigned long max;
+} histogram;
+
+/* Count one value of us microseconds */
+void histogram_record(histogram *h, long us);
+
+/* The value below which a fraction p (0-1) of the recorded values fall, in
+ * microseconds; the upper edge of its bucket */
+long histogram_percentile(histogram *h, double p);
+
+/* One line of p50, p90, p99 and max in milliseconds, labelled name */
+void histogram_print(histogram *h, const char *name, FILE *outputfile);
+
+#endif //SUDOKU_HISTOGRAM_H
@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "json.h"
+#include "http_client.h"
+
+const char *url = URL;
+int verbose = 0;
+
+struct curl_slist *config_headers() {
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    headers = curl_slist_append(headers, "Expect:");
+    return headers;
+}
+
+CURL *create_eh(const int *result, const char *json_to_send, const struct curl_slist *headers) {
+    CURL *eh = curl_easy_init();
+    curl_easy_setopt(eh, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(eh, CURLOPT_URL, url);
+    curl_easy_setopt(eh, CURLOPT_POST, 1L);
+    curl_easy_setopt(eh, CURLOPT_POSTFIELDS, json_to_send);
+    curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(eh, CURLOPT_WRITEDATA, result);
+    curl_easy_setopt(eh, CURLOPT_POSTFIELDSIZE, MATRIX_LENGTH);
+    curl_easy_setopt(eh, CURLOPT_TCP_KEEPALIVE, 1L);
+    return eh;
+}
+
+size_t write_callback(char *ptr, size_t size, size_t nmemb, void  *userdata) {
+    if (verbose) {
+        printf("Write callback message from server: %s\n", ptr);
+    }
+    int * p = (int*) userdata;
+    *p = atoi(ptr);
+    return size * nmemb;
+}
+
+double backoff_ms(int attempt) {
+    double delay = RETRY_BASE_MS * (double) (1 << (attempt - 1));
+    if (delay > RETRY_MAX_MS) {
+        delay = RETRY_MAX_MS;
+    }
+    // Equal jitter: half the delay is fixed, the other half random
+    return delay / 2 + delay / 2 * rand() / RAND_MAX;
+}
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
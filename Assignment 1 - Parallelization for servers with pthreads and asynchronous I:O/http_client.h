@@ -0,0 +1,36 @@
+#ifndef SUDOKU_HTTP_CLIENT_H
+#define SUDOKU_HTTP_CLIENT_H
+#include <curl/curl.h>
+
+/* The /verify server, shared by every verifier */
+#define URL "http://berkeley.uwaterloo.ca:4590/verify"
+
+/* Defaults for the timeout and retries of a single request */
+#define REQUEST_TIMEOUT_MS 5000
+#define MAX_RETRIES 3
+#define RETRY_BASE_MS 50
+#define RETRY_MAX_MS 2000
+
+/* Server to verify against; URL unless overridden with -u */
+extern const char *url;
+
+/* Print every server response */
+extern int verbose;
+
+/* Configure headers for the cURL request */
+struct curl_slist *config_headers();
+
+/* Create a cURL easy handle that posts json_to_send to url and parses the
+ * verdict in the answer into result */
+CURL *create_eh(const int *result, const char *json_to_send, const struct curl_slist *headers);
+
+/* cURL write callback; userdata is the int the verdict goes into */
+size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata);
+
+/* Jittered exponential backoff before the given retry (from 1), in ms */
+double backoff_ms(int attempt);
+
+/* Monotonic time in ms */
+double now_ms();
+
+#endif //SUDOKU_HTTP_CLIENT_H
@@ -0,0 +1,30 @@
+#include <stdio.h>
+#include <string.h>
+#include "json.h"
+
+/* The encoding of an all-zero grid; every cell is a single digit at a fixed offset */
+static const char TEMPLATE[MATRIX_LENGTH] =
+    "{\"content\":[[0,0,0,0,0,0,0,0,0], [0,0,0,0,0,0,0,0,0], [0,0,0,0,0,0,0,0,0], "
+    "[0,0,0,0,0,0,0,0,0], [0,0,0,0,0,0,0,0,0], [0,0,0,0,0,0,0,0,0], "
+    "[0,0,0,0,0,0,0,0,0], [0,0,0,0,0,0,0,0,0], [0,0,0,0,0,0,0,0,0]]}";
+
+/* "{\"content\":[" is 12 characters, each row "[d,...,d], " is 21 */
+#define CELL_OFFSET(row, column) (12 + 21 * (row) + 1 + 2 * (column))
+
+static const unsigned char OFFSETS[81] = {
+#define ROW(r) CELL_OFFSET(r, 0), CELL_OFFSET(r, 1), CELL_OFFSET(r, 2), \
+               CELL_OFFSET(r, 3), CELL_OFFSET(r, 4), CELL_OFFSET(r, 5), \
+               CELL_OFFSET(r, 6), CELL_OFFSET(r, 7), CELL_OFFSET(r, 8)
+    ROW(0), ROW(1), ROW(2), ROW(3), ROW(4), ROW(5), ROW(6), ROW(7), ROW(8)
+#undef ROW
+};
+
+void encode_puzzle(puzzle *p, char *json) {
+    const int *cells = &p->content[0][0];
+    memcpy(json, TEMPLATE, MATRIX_LENGTH);
+    for (int i = 0; i < 81; i++) {
+        /* Anything that is not a digit cannot be valid; send it as a blank */
+        unsigned cell = cells[i];
+        json[OFFSETS[i]] = cell <= 9 ? '0' + cell : '0';
+    }
+}
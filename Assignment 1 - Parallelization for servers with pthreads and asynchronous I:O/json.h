@@ -0,0 +1,12 @@
+#ifndef SUDOKU_JSON_H
+#define SUDOKU_JSON_H
+#include "common.h"
+
+/* Size of an encoded grid, {"content":[[...], ...]}, including its NUL */
+#define MATRIX_LENGTH 202
+
+/* Transform the puzzle into the json format the server expects, writing
+ * MATRIX_LENGTH bytes into json; no allocation and no format parsing */
+void encode_puzzle(puzzle *p, char *json);
+
+#endif //SUDOKU_JSON_H
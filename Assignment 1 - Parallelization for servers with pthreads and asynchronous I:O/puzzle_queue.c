@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include "puzzle_queue.h"
+
+int puzzle_queue_init(puzzle_queue *q, unsigned long capacity) {
+    unsigned long size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    q->cells = malloc(size * sizeof(puzzle_queue_cell));
+    if (q->cells == NULL) {
+        return -1;
+    }
+    /* Cell i is free for the push at position i */
+    for (unsigned long i = 0; i < size; i++) {
+        q->cells[i].item = NULL;
+        q->cells[i].sequence = i;
+    }
+    q->mask = size - 1;
+    q->head = 0;
+    q->tail = 0;
+    q->closed = 0;
+    return 0;
+}
+
+void puzzle_queue_destroy(puzzle_queue *q) {
+    free(q->cells);
+}
+
+int puzzle_queue_push(puzzle_queue *q, puzzle *p) {
+    unsigned long position = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    while (1) {
+        puzzle_queue_cell *cell = &q->cells[position & q->mask];
+        unsigned long sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long) (sequence - position);
+        if (diff == 0) {
+            /* The cell is free; claim it by moving the tail past it */
+            if (__atomic_compare_exchange_n(&q->tail, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->item = p;
+                __atomic_store_n(&cell->sequence, position + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            /* Still holds the puzzle pushed one lap ago */
+            return 0;
+        } else {
+            position = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+puzzle *puzzle_queue_pop(puzzle_queue *q) {
+    unsigned long position = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    while (1) {
+        puzzle_queue_cell *cell = &q->cells[position & q->mask];
+        unsigned long sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long) (sequence - (position + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &position, position + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                puzzle *p = cell->item;
+                /* Free the cell for the push one lap ahead */
+                __atomic_store_n(&cell->sequence, position + q->mask + 1, __ATOMIC_RELEASE);
+                return p;
+            }
+        } else if (diff < 0) {
+            /* Not pushed yet */
+            return NULL;
+        } else {
+            position = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void puzzle_queue_close(puzzle_queue *q) {
+    __atomic_store_n(&q->closed, 1, __ATOMIC_RELEASE);
+}
+
+int puzzle_queue_drained(puzzle_queue *q) {
+    if (!__atomic_load_n(&q->closed, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) >= __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+}
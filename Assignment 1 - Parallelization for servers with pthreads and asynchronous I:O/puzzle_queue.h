@@ -0,0 +1,45 @@
+#ifndef SUDOKU_PUZZLE_QUEUE_H
+#define SUDOKU_PUZZLE_QUEUE_H
+#include <stdio.h>
+#include "common.h"
+
+/* Bounded multi-producer, multi-consumer queue of puzzles without a lock:
+ * every cell carries a sequence number that tells a producer it is free and
+ * a consumer it is full, so threads only contend on one compare-and-swap of
+ * the head or tail index.  Head and tail sit on separate cache lines */
+typedef struct {
+    puzzle *item;
+    unsigned long sequence;
+} puzzle_queue_cell;
+
+typedef struct {
+    puzzle_queue_cell *cells;
+    unsigned long mask;
+    char pad0[64];
+    unsigned long head;         /* next cell to pop */
+    char pad1[64];
+    unsigned long tail;         /* next cell to push */
+    char pad2[64];
+    int closed;                 /* no more pushes will come */
+} puzzle_queue;
+
+/* Room for capacity puzzles, rounded up to a power of two; returns -1 if the
+ * cells cannot be allocated */
+int puzzle_queue_init(puzzle_queue *q, unsigned long capacity);
+
+void puzzle_queue_destroy(puzzle_queue *q);
+
+/* Append p; returns 0 if the queue is full */
+int puzzle_queue_push(puzzle_queue *q, puzzle *p);
+
+/* Take the oldest puzzle; NULL if the queue is empty right now */
+puzzle *puzzle_queue_pop(puzzle_queue *q);
+
+/* Called by the producer after its last push */
+void puzzle_queue_close(puzzle_queue *q);
+
+/* Returns 1 once the queue is closed and empty; a pop that returns NULL after
+ * this is final */
+int puzzle_queue_drained(puzzle_queue *q);
+
+#endif //SUDOKU_PUZZLE_QUEUE_H
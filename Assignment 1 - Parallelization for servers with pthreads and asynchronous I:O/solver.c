@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <string.h>
+#include "solver.h"
+
+#define ALL_DIGITS 0x3FE
+#define BOX_OF(row, column) (3 * ((row) / 3) + (column) / 3)
+
+/* Scratch state for one depth-first search over the blank cells */
+typedef struct {
+    unsigned char grid[81];
+    unsigned short rows[9];
+    unsigned short cols[9];
+    unsigned short boxes[9];
+    unsigned char empty[81];
+    int num_empty;
+    const unsigned char *hint;    /* digit to try first per cell, or NULL */
+    int limit;
+    int found;
+    unsigned char first[81];      /* first solution found */
+} search_state;
+
+/*
+ * Set up a search over grid, treating every cell with unfixed[i] set (and every
+ * cell holding 0) as blank.  Returns -1 if the fixed cells already conflict.
+ */
+static int prepare(search_state *ss, const unsigned char *grid, const unsigned char *unfixed) {
+    memset(ss->rows, 0, sizeof(ss->rows));
+    memset(ss->cols, 0, sizeof(ss->cols));
+    memset(ss->boxes, 0, sizeof(ss->boxes));
+    ss->num_empty = 0;
+    ss->found = 0;
+    for (int i = 0; i < 81; i++) {
+        int row = i / 9;
+        int column = i % 9;
+        int box = BOX_OF(row, column);
+        if (grid[i] == 0 || (unfixed != NULL && unfixed[i])) {
+            ss->grid[i] = 0;
+            ss->empty[ss->num_empty++] = i;
+            continue;
+        }
+        unsigned short bit = 1 << grid[i];
+        if ((ss->rows[row] | ss->cols[column] | ss->boxes[box]) & bit) {
+            return -1;
+        }
+        ss->grid[i] = grid[i];
+        ss->rows[row] |= bit;
+        ss->cols[column] |= bit;
+        ss->boxes[box] |= bit;
+    }
+    return 0;
+}
+
+/*
+ * Fill the blank cells from position depth onwards, always branching on the
+ * cell with the fewest candidates.  Returns 1 once limit solutions are found.
+ */
+static int search(search_state *ss, int depth) {
+    if (depth == ss->num_empty) {
+        if (ss->found++ == 0) {
+            memcpy(ss->first, ss->grid, 81);
+        }
+        return ss->found >= ss->limit;
+    }
+
+    /* Pick the most constrained blank cell and move it to position depth */
+    int best = depth;
+    int best_count = 10;
+    unsigned short best_candidates = 0;
+    for (int k = depth; k < ss->num_empty; k++) {
+        int i = ss->empty[k];
+        int row = i / 9;
+        int column = i % 9;
+        unsigned short candidates = ~(ss->rows[row] | ss->cols[column]
+                                      | ss->boxes[BOX_OF(row, column)]) & ALL_DIGITS;
+        int count = __builtin_popcount(candidates);
+        if (count < best_count) {
+            best = k;
+            best_count = count;
+            best_candidates = candidates;
+            if (count <= 1) break;
+        }
+    }
+    if (best_count == 0) return 0;
+
+    unsigned char cell = ss->empty[best];
+    ss->empty[best] = ss->empty[depth];
+    ss->empty[depth] = cell;
+
+    int row = cell / 9;
+    int column = cell % 9;
+    int box = BOX_OF(row, column);
+
+    /* Try the hinted digit first; it is usually still right after an edit */
+    int hinted = ss->hint != NULL ? ss->hint[cell] : 0;
+    if (hinted && (best_candidates & (1 << hinted))) {
+        best_candidates &= ~(1 << hinted);
+    } else {
+        hinted = 0;
+    }
+
+    while (hinted || best_candidates) {
+        int number;
+        if (hinted) {
+            number = hinted;
+            hinted = 0;
+        } else {
+            number = __builtin_ctz(best_candidates);
+            best_candidates &= best_candidates - 1;
+        }
+        unsigned short bit = 1 << number;
+        ss->grid[cell] = number;
+        ss->rows[row] |= bit;
+        ss->cols[column] |= bit;
+        ss->boxes[box] |= bit;
+        int done = search(ss, depth + 1);
+        ss->rows[row] &= ~bit;
+        ss->cols[column] &= ~bit;
+        ss->boxes[box] &= ~bit;
+        if (done) return 1;
+    }
+    ss->grid[cell] = 0;
+    return 0;
+}
+
+/* Mark every non-given peer (same row, column or box) of cell as free */
+static void free_peers(solver *s, int cell, unsigned char *unfixed) {
+    int row = cell / 9;
+    int column = cell % 9;
+    int box_row = 3 * (row / 3);
+    int box_col = 3 * (column / 3);
+    for (int k = 0; k < 9; k++) {
+        int peers[3] = {
+            row * 9 + k,
+            k * 9 + column,
+            (box_row + k / 3) * 9 + box_col + k % 3
+        };
+        for (int j = 0; j < 3; j++) {
+            if (!s->given[peers[j]]) unfixed[peers[j]] = 1;
+        }
+    }
+}
+
+int solver_load(solver *s, puzzle *p) {
+    memset(s, 0, sizeof(*s));
+    s->dirty_cell = -1;
+    for (int row = 0; row < 9; row++) {
+        for (int column = 0; column < 9; column++) {
+            int number = p->content[row][column];
+            if (number == 0) continue;
+            if (solver_place(s, row, column, number) < 0) return -1;
+        }
+    }
+    return 0;
+}
+
+int solver_place(solver *s, int row, int column, int number) {
+    int cell = row * 9 + column;
+    int box = BOX_OF(row, column);
+    if (number < 1 || number > 9) return -1;
+    unsigned short bit = 1 << number;
+
+    if (s->given[cell] == number) {
+        return s->has_solution;
+    }
+    int previous = s->given[cell];
+    unsigned short previous_bit = previous ? 1 << previous : 0;
+    if (((s->rows[row] | s->cols[column] | s->boxes[box]) & ~previous_bit) & bit) {
+        return -1;
+    }
+
+    s->rows[row] = (s->rows[row] & ~previous_bit) | bit;
+    s->cols[column] = (s->cols[column] & ~previous_bit) | bit;
+    s->boxes[box] = (s->boxes[box] & ~previous_bit) | bit;
+    s->given[cell] = number;
+
+    /* The cached solution already agrees with the new given: nothing to do */
+    if (s->has_solution && s->solution[cell] == number) {
+        return 1;
+    }
+    /* Only a single edit away from a known solution can be repaired locally */
+    s->dirty_cell = s->has_solution ? cell : -1;
+    s->has_solution = 0;
+    return 0;
+}
+
+void solver_clear(solver *s, int row, int column) {
+    int cell = row * 9 + column;
+    if (s->given[cell] == 0) return;
+    unsigned short bit = 1 << s->given[cell];
+    s->rows[row] &= ~bit;
+    s->cols[column] &= ~bit;
+    s->boxes[BOX_OF(row, column)] &= ~bit;
+    s->given[cell] = 0;
+}
+
+int solver_solve(solver *s) {
+    search_state ss;
+    unsigned char unfixed[81];
+
+    if (s->has_solution) return 1;
+    ss.limit = 1;
+
+    /*
+     * Repair the previous solution around the edited cell: free the cells
+     * that now clash with it and search only those, widening the frontier
+     * to their peers a couple of times before giving up on the old solution.
+     */
+    if (s->dirty_cell >= 0) {
+        int cell = s->dirty_cell;
+        unsigned char grid[81];
+        memset(unfixed, 0, sizeof(unfixed));
+        for (int i = 0; i < 81; i++) {
+            grid[i] = s->given[i] ? s->given[i] : s->solution[i];
+        }
+        unsigned char peers[81] = {0};
+        free_peers(s, cell, peers);
+        for (int i = 0; i < 81; i++) {
+            if (peers[i] && grid[i] == s->given[cell]) unfixed[i] = 1;
+        }
+        ss.hint = s->solution;
+        for (int level = 0; level < 3; level++) {
+            if (prepare(&ss, grid, unfixed) == 0 && search(&ss, 0)) {
+                memcpy(s->solution, ss.first, 81);
+                s->has_solution = 1;
+                s->dirty_cell = -1;
+                return 1;
+            }
+            unsigned char frontier[81];
+            memcpy(frontier, unfixed, sizeof(frontier));
+            free_peers(s, cell, unfixed);
+            for (int i = 0; i < 81; i++) {
+                if (frontier[i]) free_peers(s, i, unfixed);
+            }
+        }
+    }
+
+    /* Fall back to a full search from the givens */
+    ss.hint = s->solution;
+    s->dirty_cell = -1;
+    if (prepare(&ss, s->given, NULL) == 0 && search(&ss, 0)) {
+        memcpy(s->solution, ss.first, 81);
+        s->has_solution = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int solver_count(solver *s, int limit) {
+    search_state ss;
+    ss.limit = limit;
+    ss.hint = s->has_solution ? s->solution : NULL;
+    if (prepare(&ss, s->given, NULL) != 0) return 0;
+    search(&ss, 0);
+    if (ss.found > 0 && !s->has_solution) {
+        memcpy(s->solution, ss.first, 81);
+        s->has_solution = 1;
+        s->dirty_cell = -1;
+    }
+    return ss.found;
+}
+
+void solver_get(solver *s, puzzle *p) {
+    for (int row = 0; row < 9; row++) {
+        for (int column = 0; column < 9; column++) {
+            p->content[row][column] = s->solution[row * 9 + column];
+        }
+    }
+}
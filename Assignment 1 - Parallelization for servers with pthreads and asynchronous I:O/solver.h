@@ -0,0 +1,41 @@
+#ifndef SUDOKU_SOLVER_H
+#define SUDOKU_SOLVER_H
+#include "common.h"
+
+/* A solver handle keeps the constraint state of one puzzle (its givens and
+ * the row/column/box digit masks they imply) together with the last solution
+ * found, so that single-cell edits can be answered without a full re-search.
+ * Cells are addressed as in solve(): row and column in 0..8. */
+typedef struct {
+    unsigned char given[81];      /* 0 for blank, otherwise the fixed digit */
+    unsigned char solution[81];   /* last solution found */
+    unsigned short rows[9];       /* bit d set if digit d is given in the row */
+    unsigned short cols[9];
+    unsigned short boxes[9];
+    int has_solution;             /* solution[] satisfies every given */
+    int dirty_cell;               /* cell of the last edit that invalidated it */
+} solver;
+
+/* Load the givens of p into s, discarding any previous state;
+ * returns 0 on success, -1 if the givens already conflict */
+int solver_load(solver *s, puzzle *p);
+
+/* Fix number (1-9) at the given cell, replacing any previous given there;
+ * returns 1 if the cached solution is still valid, 0 if solver_solve() has to
+ * search again, -1 if number conflicts with another given (s is unchanged) */
+int solver_place(solver *s, int row, int column, int number);
+
+/* Make the given cell blank again; the cached solution stays valid */
+void solver_clear(solver *s, int row, int column);
+
+/* Bring the cached solution up to date with the givens;
+ * returns 1 if the puzzle is solvable, 0 if not */
+int solver_solve(solver *s);
+
+/* Count solutions of the current givens, stopping once limit is reached */
+int solver_count(solver *s, int limit);
+
+/* Copy the cached solution into p */
+void solver_get(solver *s, puzzle *p);
+
+#endif //SUDOKU_SOLVER_H
@@ -32,6 +32,9 @@
 #include <getopt.h>
 #include "common.h"
 
+/* Write solutions one per line of 81 cells (-c) */
+int compact_output = 0;
+
 /* Check the common header for the definition of puzzle */
 
 /* Check if current number is valid in this position;
@@ -52,7 +55,7 @@ int main(int argc, char **argv) {
     int c;
     int num_threads = 1;
     char *filename = NULL;
-    while ((c = getopt(argc, argv, "t:i:")) != -1) {
+    while ((c = getopt(argc, argv, "t:i:c")) != -1) {
         switch (c) {
             case 't':
                 num_threads = strtoul(optarg, NULL, 10);
@@ -61,6 +64,9 @@ int main(int argc, char **argv) {
                     return EXIT_FAILURE;
                 }
                 break;
+            case 'c':
+                compact_output = 1;
+                break;
             case 'i':
                 filename = optarg;
                 break;
@@ -174,6 +180,10 @@ int is_valid(int number, puzzle *p, int row, int column) {
  * Convenience function to print out the puzzle.
  */
 void write_to_file(puzzle *p, FILE *outputfile) {
+    if (compact_output) {
+        write_compact(p, outputfile);
+        return;
+    }
     for (int i = 0; i < 9; i++) {
         for (int j = 0; j < 9; j++) {
             if (8 == j) {
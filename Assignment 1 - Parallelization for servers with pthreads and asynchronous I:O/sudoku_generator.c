@@ -0,0 +1,264 @@
+/*
+ * Generates puzzles with a unique solution on top of the incremental solver
+ * handle (see solver.h).  Each thread fills a random solved grid, then clears
+ * its cells in random order, keeping a removal only while a search bounded to
+ * two solutions still finds exactly one.  A single pass rarely gets below
+ * about 22 clues, so while the target is not reached the generator puts back
+ * one cleared clue and removes again in a fresh random order, keeping the new
+ * puzzle unless it has more clues, for up to WALK_STEPS rounds per grid.
+ * Each puzzle gets at most -a grids; 17 to 19 clues are seldom reached, so
+ * puzzles that run out of attempts are reported and the generator exits with
+ * failure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <getopt.h>
+#include "common.h"
+#include "solver.h"
+
+/* Rounds of putting back a clue per grid before starting from a fresh one */
+#define WALK_STEPS 2000
+
+FILE *outputfile;
+pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int num_threads = 1;
+int num_puzzles = 1;
+int target_clues = 30;
+long max_attempts = 1000;
+int compact_output = 0;
+uint64_t seed = 459;
+
+int assigned_puzzles = 0;
+int failed_puzzles = 0;
+long total_attempts = 0;
+
+void *generator_thread(void *argp);
+
+/* Try once to reach target_clues from a fresh random grid;
+ * returns 1 and the puzzle in p on success */
+int generate(uint64_t *rng, puzzle *p);
+
+/* Clear the givens of s in random order while the solution stays unique,
+ * stopping at target_clues; returns the number of clues left */
+int remove_clues(solver *s, uint64_t *rng, int clues);
+
+uint64_t next_random(uint64_t *rng);
+
+void write_to_file(puzzle *p, FILE *outputfile);
+
+int main(int argc, char **argv) {
+    /* Parse arguments */
+    int c;
+    char *filename = NULL;
+    while ((c = getopt(argc, argv, "t:n:k:a:s:o:c")) != -1) {
+        switch (c) {
+            case 't':
+                num_threads = strtoul(optarg, NULL, 10);
+                if (num_threads == 0) {
+                    printf("%s: option requires an argument > 0 -- 't'\n", argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                num_puzzles = strtoul(optarg, NULL, 10);
+                break;
+            case 'k':
+                target_clues = strtoul(optarg, NULL, 10);
+                if (target_clues < 17 || target_clues > 81) {
+                    printf("%s: option requires an argument from 17 to 81 -- 'k'\n", argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'a':
+                max_attempts = strtol(optarg, NULL, 10);
+                if (max_attempts <= 0) {
+                    printf("%s: option requires an argument > 0 -- 'a'\n", argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'o':
+                filename = optarg;
+                break;
+            case 'c':
+                compact_output = 1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    /* Open File; puzzles go to stdout unless -o is given */
+    outputfile = filename != NULL ? fopen(filename, "w+") : stdout;
+    if (outputfile == NULL) {
+        printf("Unable to open output file.\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t tid[num_threads];
+    uint64_t rngs[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        rngs[i] = seed * 0x9E3779B97F4A7C15ULL + i + 1;
+        pthread_create(&tid[i], NULL, generator_thread, &rngs[i]);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    fprintf(stderr, "Generated %d puzzles with %d clues in %ld attempts.\n",
+            num_puzzles - failed_puzzles, target_clues, total_attempts);
+    if (failed_puzzles > 0) {
+        fprintf(stderr, "Gave up on %d puzzles after %ld attempts each.\n",
+                failed_puzzles, max_attempts);
+    }
+    if (outputfile != stdout) {
+        fclose( outputfile );
+    }
+    return failed_puzzles > 0 ? EXIT_FAILURE : 0;
+}
+
+void *generator_thread(void *argp) {
+    uint64_t *rng = argp;
+    puzzle p;
+
+    while (1) {
+        pthread_mutex_lock(&output_lock);
+        if (assigned_puzzles == num_puzzles) {
+            pthread_mutex_unlock(&output_lock);
+            break;
+        }
+        assigned_puzzles++;
+        pthread_mutex_unlock(&output_lock);
+
+        long attempts = 1;
+        int generated;
+        while (!(generated = generate(rng, &p)) && attempts < max_attempts) {
+            attempts++;
+        }
+
+        pthread_mutex_lock(&output_lock);
+        if (generated) {
+            write_to_file(&p, outputfile);
+        } else {
+            failed_puzzles++;
+        }
+        total_attempts += attempts;
+        pthread_mutex_unlock(&output_lock);
+    }
+    return NULL;
+}
+
+int generate(uint64_t *rng, puzzle *p) {
+    solver s;
+
+    /* The three diagonal boxes are independent: fill them with random
+     * permutations and let the solver complete the grid */
+    memset(p, 0, sizeof(*p));
+    for (int box = 0; box < 3; box++) {
+        unsigned char digits[9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+        for (int i = 8; i > 0; i--) {
+            int j = next_random(rng) % (i + 1);
+            unsigned char tmp = digits[i];
+            digits[i] = digits[j];
+            digits[j] = tmp;
+        }
+        for (int i = 0; i < 9; i++) {
+            p->content[3 * box + i / 3][3 * box + i % 3] = digits[i];
+        }
+    }
+    solver_load(&s, p);
+    if (!solver_solve(&s)) return 0;
+    /* Start from the full grid as givens */
+    solver_get(&s, p);
+    solver_load(&s, p);
+    solver_solve(&s);
+
+    unsigned char full[81];
+    memcpy(full, s.given, sizeof(full));
+    int clues = remove_clues(&s, rng, 81);
+
+    /* Put back one of the cleared clues and remove again; moves that keep
+     * the clue count let the search drift to other minimal puzzles */
+    for (int step = 0; step < WALK_STEPS && clues > target_clues; step++) {
+        solver next = s;
+        int cell;
+        do {
+            cell = next_random(rng) % 81;
+        } while (next.given[cell]);
+        solver_place(&next, cell / 9, cell % 9, full[cell]);
+        int next_clues = remove_clues(&next, rng, clues + 1);
+        if (next_clues <= clues) {
+            s = next;
+            clues = next_clues;
+        }
+    }
+    if (clues > target_clues) return 0;
+
+    for (int i = 0; i < 81; i++) {
+        p->content[i / 9][i % 9] = s.given[i];
+    }
+    return 1;
+}
+
+int remove_clues(solver *s, uint64_t *rng, int clues) {
+    unsigned char order[81];
+
+    for (int i = 0; i < 81; i++) {
+        order[i] = i;
+    }
+    for (int i = 80; i > 0; i--) {
+        int j = next_random(rng) % (i + 1);
+        unsigned char tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (int i = 0; i < 81 && clues > target_clues; i++) {
+        int row = order[i] / 9;
+        int column = order[i] % 9;
+        int number = s->given[order[i]];
+        if (!number) continue;
+        solver_clear(s, row, column);
+        if (solver_count(s, 2) == 1) {
+            clues--;
+        } else {
+            solver_place(s, row, column, number);
+        }
+    }
+    return clues;
+}
+
+/* xorshift64*; each thread owns its state */
+uint64_t next_random(uint64_t *rng) {
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+ * Print the puzzle in the solver input format, with dots for blanks.
+ */
+void write_to_file(puzzle *p, FILE *outputfile) {
+    if (compact_output) {
+        write_compact(p, outputfile);
+        return;
+    }
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            char cell = p->content[i][j] ? '0' + p->content[i][j] : '.';
+            if (8 == j) {
+                fprintf(outputfile, "%c\n", cell);
+            } else {
+                fprintf(outputfile, "%c", cell);
+            }
+        }
+    }
+    fprintf(outputfile, "\n\n");
+}
@@ -0,0 +1,162 @@
+/*
+ * A sudoku solver built on the incremental solver handle (see solver.h).
+ * Reads and writes the same format as sudoku.c.  With -e, every line of the
+ * edits file ("row column number", 0-based, number 0 to clear the cell) is
+ * applied in turn to each puzzle after it is solved, and the time taken to
+ * bring the solution up to date is reported for every edit.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <getopt.h>
+#include "common.h"
+#include "solver.h"
+
+/* Write solutions one per line of 81 cells (-c) */
+int compact_output = 0;
+
+typedef struct {
+    int row;
+    int column;
+    int number;
+} edit;
+
+void write_to_file(puzzle *p, FILE *outputfile);
+
+/* Read the whole edits file; returns the number of edits read */
+int read_edits(FILE *editsfile, edit **edits);
+
+void apply_edits(solver *s, int current_puzzle, edit *edits, int num_edits);
+
+int main(int argc, char **argv) {
+    FILE *inputfile;
+    FILE *outputfile;
+    FILE *editsfile;
+    puzzle *p;
+    solver s;
+    int current_puzzle = 0;
+    edit *edits = NULL;
+    int num_edits = 0;
+
+    /* Parse arguments */
+    int c;
+    char *filename = NULL;
+    char *edits_filename = NULL;
+    while ((c = getopt(argc, argv, "i:e:c")) != -1) {
+        switch (c) {
+            case 'c':
+                compact_output = 1;
+                break;
+            case 'i':
+                filename = optarg;
+                break;
+            case 'e':
+                edits_filename = optarg;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    /* Open Files */
+    inputfile = fopen(filename, "r");
+    if (inputfile == NULL) {
+        printf("Unable to open input file.\n");
+        return EXIT_FAILURE;
+    }
+    outputfile = fopen("output.txt", "w+");
+    if (outputfile == NULL) {
+        printf("Unable to open output file.\n");
+        return EXIT_FAILURE;
+    }
+    if (edits_filename != NULL) {
+        editsfile = fopen(edits_filename, "r");
+        if (editsfile == NULL) {
+            printf("Unable to open edits file.\n");
+            return EXIT_FAILURE;
+        }
+        num_edits = read_edits(editsfile, &edits);
+        fclose(editsfile);
+    }
+
+    /* Main loop - load the puzzle into the handle, solve, write to file */
+    while ((p = read_next_puzzle(inputfile)) != NULL) {
+        current_puzzle++;
+        if (solver_load(&s, p) == 0 && solver_solve(&s)) {
+            solver_get(&s, p);
+            write_to_file(p, outputfile);
+            apply_edits(&s, current_puzzle, edits, num_edits);
+        } else {
+            printf("Illegal sudoku (number %d in the file) (or a broken algorithm)\n", current_puzzle);
+        }
+        free(p);
+    }
+
+    free(edits);
+    fclose( inputfile );
+    fclose( outputfile );
+    return 0;
+}
+
+int read_edits(FILE *editsfile, edit **edits) {
+    int capacity = 16;
+    int count = 0;
+    edit e;
+    *edits = malloc(capacity * sizeof(edit));
+    while (fscanf(editsfile, "%d %d %d", &e.row, &e.column, &e.number) == 3) {
+        if (e.row < 0 || e.row > 8 || e.column < 0 || e.column > 8
+            || e.number < 0 || e.number > 9) {
+            printf("Ignoring out of range edit %d %d %d\n", e.row, e.column, e.number);
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            *edits = realloc(*edits, capacity * sizeof(edit));
+        }
+        (*edits)[count++] = e;
+    }
+    return count;
+}
+
+void apply_edits(solver *s, int current_puzzle, edit *edits, int num_edits) {
+    struct timespec start, end;
+    for (int i = 0; i < num_edits; i++) {
+        const char *outcome;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (edits[i].number == 0) {
+            solver_clear(s, edits[i].row, edits[i].column);
+            outcome = solver_solve(s) ? "solved" : "unsolvable";
+        } else if (solver_place(s, edits[i].row, edits[i].column, edits[i].number) < 0) {
+            outcome = "conflict";
+        } else {
+            outcome = solver_solve(s) ? "solved" : "unsolvable";
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        printf("Puzzle %d: edit (%d,%d)=%d %s in %.2f us\n", current_puzzle,
+               edits[i].row, edits[i].column, edits[i].number, outcome, elapsed);
+    }
+}
+
+/*
+ * Convenience function to print out the puzzle.
+ */
+void write_to_file(puzzle *p, FILE *outputfile) {
+    if (compact_output) {
+        write_compact(p, outputfile);
+        return;
+    }
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            if (8 == j) {
+                fprintf(outputfile, "%d\n", p->content[i][j]);
+            } else {
+                fprintf(outputfile, "%d", p->content[i][j]);
+            }
+        }
+    }
+    fprintf(outputfile, "\n\n");
+}
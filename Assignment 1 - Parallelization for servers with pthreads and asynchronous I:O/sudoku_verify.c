@@ -0,0 +1,417 @@
+/*
+ * Solve and verify in one process, without the output.txt round trip.
+ * Solver threads (-t) take puzzles from the input, solve them with the
+ * incremental solver handle and push the grids, tagged with their position
+ * in the input, into a bounded queue.  The main thread drains the queue into
+ * a window of -n in-flight /verify requests (or the local validator with -l).
+ * A full window stops the draining and a full queue blocks the solvers, so
+ * backpressure flows from the network back to the solvers.  A request that
+ * fails, times out (-T ms) or gets a server error is sent again up to -r
+ * times after a jittered exponential backoff.  With -o, one "index verdict"
+ * line per puzzle is written in completion order, where verdict is 1, 0, -1
+ * for a puzzle the solver could not solve, or -2 for one the server never
+ * answered.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include <getopt.h>
+#include "common.h"
+#include "solver.h"
+#include "validator.h"
+#include "json.h"
+#include "http_client.h"
+
+#define MAX_WAIT_MSECS 30*1000 /* Wait max. 30 seconds */
+#define QUEUE_CAPACITY 256
+
+/* A solved grid on its way from a solver thread to the verifier */
+typedef struct {
+    int index;
+    int solved;
+    puzzle p;
+} queue_item;
+
+/* Bounded queue between the solver threads and the verifier */
+typedef struct {
+    queue_item items[QUEUE_CAPACITY];
+    int head;
+    int count;
+    int open_producers;         /* solver threads still running */
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+} solved_queue;
+
+/* One in-flight request; slots and their easy handles live for the whole run */
+typedef struct {
+    CURL *eh;
+    int result;
+    int index;
+    int busy;                   /* holds a puzzle, sent or waiting to retry */
+    int attempts;               /* failed attempts so far */
+    double retry_at;            /* ms; when a failed request goes out again, 0 if not waiting */
+    char json[MATRIX_LENGTH];
+} request_slot;
+
+FILE *inputfile;
+FILE *verdictfile;
+pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+int next_index = 0;
+
+solved_queue queue;
+CURLM *cm;
+
+int num_threads = 1;
+int num_connections = 1;
+int local = 0;
+long request_timeout = REQUEST_TIMEOUT_MS;
+int max_retries = MAX_RETRIES;
+
+int verified = 0;
+int failed = 0;
+int total_puzzles = 0;
+
+void *solver_thread();
+
+/* Block while the queue is full, then append item */
+void queue_push(queue_item *item);
+
+/* Take the oldest item; returns 0 if the queue is empty (and, when block is
+ * set, only once every solver has finished) */
+int queue_pop(queue_item *item, int block);
+
+/* Returns 1 once the queue is empty and every solver has finished */
+int queue_finished();
+
+/* Record the verdict for the puzzle at index; -2 if it could not be verified */
+void record(int index, int verdict);
+
+void local_stage();
+
+void network_stage();
+
+int main(int argc, char **argv) {
+    /* Parse arguments */
+    int c;
+    char *filename = NULL;
+    char *verdict_filename = NULL;
+    while ((c = getopt(argc, argv, "t:n:i:o:u:T:r:l")) != -1) {
+        switch (c) {
+            case 't':
+                num_threads = strtoul(optarg, NULL, 10);
+                if (num_threads == 0) {
+                    printf("%s: option requires an argument > 0 -- 't'\n", argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n':
+                num_connections = strtoul(optarg, NULL, 10);
+                if (num_connections == 0) {
+                    printf("%s: option requires an argument > 0 -- 'n'\n", argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'i':
+                filename = optarg;
+                break;
+            case 'o':
+                verdict_filename = optarg;
+                break;
+            case 'u':
+                url = optarg;
+                break;
+            case 'T':
+                request_timeout = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                max_retries = strtoul(optarg, NULL, 10);
+                break;
+            case 'l':
+                local = 1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    /* Open files */
+    inputfile = fopen(filename, "r");
+    if (inputfile == NULL) {
+        printf("Unable to open input file.\n");
+        return EXIT_FAILURE;
+    }
+    if (verdict_filename != NULL) {
+        verdictfile = fopen(verdict_filename, "w+");
+        if (verdictfile == NULL) {
+            printf("Unable to open verdict file.\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    queue.open_producers = num_threads;
+
+    if (!local) {
+        curl_global_init(CURL_GLOBAL_ALL);
+        cm = curl_multi_init();
+    }
+
+    pthread_t tid[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&tid[i], NULL, solver_thread, NULL);
+    }
+
+    if (local) {
+        local_stage();
+    } else {
+        network_stage();
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    printf("%d of %d puzzles passed verification.\n", verified, total_puzzles);
+    if (failed > 0) {
+        printf("%d puzzles could not be verified.\n", failed);
+    }
+
+    if (!local) {
+        curl_multi_cleanup(cm);
+        curl_global_cleanup();
+    }
+    if (verdictfile != NULL) {
+        fclose( verdictfile );
+    }
+    fclose( inputfile );
+    return 0;
+}
+
+void *solver_thread() {
+    solver s;
+    queue_item item;
+    puzzle *p;
+
+    while (1) {
+        pthread_mutex_lock(&input_lock);
+        p = read_next_puzzle(inputfile);
+        item.index = next_index++;
+        pthread_mutex_unlock(&input_lock);
+        if (p == NULL) {
+            break;
+        }
+
+        item.solved = solver_load(&s, p) == 0 && solver_solve(&s);
+        if (item.solved) {
+            solver_get(&s, &item.p);
+        }
+        free(p);
+        queue_push(&item);
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.open_producers--;
+    pthread_cond_broadcast(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+    if (!local) {
+        curl_multi_wakeup(cm);
+    }
+    return NULL;
+}
+
+void queue_push(queue_item *item) {
+    pthread_mutex_lock(&queue.lock);
+    while (queue.count == QUEUE_CAPACITY) {
+        pthread_cond_wait(&queue.not_full, &queue.lock);
+    }
+    queue.items[(queue.head + queue.count) % QUEUE_CAPACITY] = *item;
+    queue.count++;
+    pthread_cond_signal(&queue.not_empty);
+    pthread_mutex_unlock(&queue.lock);
+
+    /* The network stage may be asleep in curl_multi_poll */
+    if (!local) {
+        curl_multi_wakeup(cm);
+    }
+}
+
+int queue_pop(queue_item *item, int block) {
+    pthread_mutex_lock(&queue.lock);
+    while (block && queue.count == 0 && queue.open_producers > 0) {
+        pthread_cond_wait(&queue.not_empty, &queue.lock);
+    }
+    if (queue.count == 0) {
+        pthread_mutex_unlock(&queue.lock);
+        return 0;
+    }
+    *item = queue.items[queue.head];
+    queue.head = (queue.head + 1) % QUEUE_CAPACITY;
+    queue.count--;
+    pthread_cond_signal(&queue.not_full);
+    pthread_mutex_unlock(&queue.lock);
+    return 1;
+}
+
+int queue_finished() {
+    pthread_mutex_lock(&queue.lock);
+    int finished = queue.count == 0 && queue.open_producers == 0;
+    pthread_mutex_unlock(&queue.lock);
+    return finished;
+}
+
+void record(int index, int verdict) {
+    total_puzzles++;
+    verified += verdict == 1;
+    failed += verdict == -2;
+    if (verdictfile != NULL) {
+        fprintf(verdictfile, "%d %d\n", index, verdict);
+    }
+}
+
+void local_stage() {
+    queue_item item;
+    while (queue_pop(&item, 1)) {
+        record(item.index, item.solved ? validate_grid(&item.p) : -1);
+    }
+}
+
+void network_stage() {
+    struct curl_slist *headers = config_headers();
+    request_slot *slots = malloc(num_connections * sizeof(request_slot));
+    request_slot *free_slots[num_connections];
+    int num_free = num_connections;
+    for (int i = 0; i < num_connections; i++) {
+        slots[i].eh = create_eh(&slots[i].result, slots[i].json, headers);
+        curl_easy_setopt(slots[i].eh, CURLOPT_TIMEOUT_MS, request_timeout);
+        curl_easy_setopt(slots[i].eh, CURLOPT_PRIVATE, &slots[i]);
+        slots[i].busy = 0;
+        slots[i].retry_at = 0;
+        free_slots[i] = &slots[i];
+    }
+
+    int in_flight = 0;          /* unanswered requests, including those waiting to retry */
+    int waiting = 0;            /* failed requests waiting out their backoff */
+    int still_running = 0;
+    queue_item item;
+    CURLMsg *msg = NULL;
+    int msgs_left = 0;
+
+    while (1) {
+        // Move solved grids into free slots; unsolvable ones need no request
+        while (num_free > 0 && queue_pop(&item, 0)) {
+            if (!item.solved) {
+                record(item.index, -1);
+                continue;
+            }
+            request_slot *slot = free_slots[--num_free];
+            slot->result = 0;
+            slot->index = item.index;
+            slot->busy = 1;
+            slot->attempts = 0;
+            encode_puzzle(&item.p, slot->json);
+            curl_multi_add_handle( cm, slot->eh );
+            in_flight ++;
+        }
+
+        if (in_flight == 0 && queue_finished()) {
+            break;
+        }
+
+        // Resend failed requests whose backoff is over
+        double now = now_ms();
+        double wake = now + MAX_WAIT_MSECS;
+        for (int i = 0; i < num_connections && waiting > 0; i++) {
+            request_slot *slot = &slots[i];
+            if (slot->retry_at == 0) {
+                continue;
+            }
+            if (slot->retry_at > now) {
+                wake = slot->retry_at < wake ? slot->retry_at : wake;
+                continue;
+            }
+            slot->retry_at = 0;
+            slot->result = 0;
+            curl_multi_add_handle( cm, slot->eh );
+            waiting --;
+        }
+
+        curl_multi_perform(cm, &still_running);
+
+        int reaped = 0;
+        while ((msg = curl_multi_info_read(cm, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+            CURL *eh = msg->easy_handle;
+            request_slot *slot;
+            curl_easy_getinfo(eh, CURLINFO_PRIVATE, (char **) &slot);
+            curl_multi_remove_handle(cm, eh);
+            reaped ++;
+
+            CURLcode res = msg->data.result;
+            long response_code = 0;
+            if (res == CURLE_OK) {
+                curl_easy_getinfo(eh, CURLINFO_RESPONSE_CODE, &response_code);
+            }
+
+            if (res != CURLE_OK || response_code != 200) {
+                if (res != CURLE_OK) {
+                    printf("Error occurred in executing the cURL request: %s\n",
+                        curl_easy_strerror(res));
+                } else {
+                    printf("Error in HTTP request; HTTP code %lu received.\n", response_code);
+                }
+                // Timeouts, connection errors and server errors are worth
+                // another try; anything else would only fail again
+                if ((res != CURLE_OK || response_code >= 500) && slot->attempts < max_retries) {
+                    slot->attempts ++;
+                    slot->retry_at = now_ms() + backoff_ms(slot->attempts);
+                    waiting ++;
+                    continue;
+                }
+                printf("Giving up on puzzle %d after %d attempts.\n", slot->index, slot->attempts + 1);
+                record(slot->index, -2);
+            } else {
+                record(slot->index, slot->result);
+            }
+            slot->busy = 0;
+            free_slots[num_free++] = slot;
+            in_flight --;
+        }
+
+        // Sleep until there is socket activity, a retry is due or a solver
+        // pushes a grid
+        if (reaped == 0) {
+            double remaining = wake - now_ms();
+            CURLMcode res = curl_multi_poll(cm, NULL, 0, remaining > 0 ? (int) remaining + 1 : 0, NULL);
+            if (res != CURLM_OK) {
+                printf("Error in curl_multi_poll(): %s\n", curl_multi_strerror(res));
+                break;
+            }
+        }
+    }
+
+    // If the loop broke off, nothing outstanding can be verified any more;
+    // keep draining the queue so that the solvers finish
+    for (int i = 0; i < num_connections; i++) {
+        if (slots[i].busy) {
+            curl_multi_remove_handle(cm, slots[i].eh);
+            record(slots[i].index, -2);
+        }
+    }
+    while (queue_pop(&item, 1)) {
+        record(item.index, item.solved ? -2 : -1);
+    }
+
+    for (int i = 0; i < num_connections; i++) {
+        curl_easy_cleanup(slots[i].eh);
+    }
+    free(slots);
+    curl_slist_free_all(headers);
+}
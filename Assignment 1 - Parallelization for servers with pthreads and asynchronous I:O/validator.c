@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "validator.h"
+
+#define ALL_DIGITS 0x3FE
+#define BATCH_SIZE 256
+
+typedef struct {
+    FILE *inputfile;
+    pthread_mutex_t *input_lock;
+    int verified;
+    int total_puzzles;
+} validator_args;
+
+#ifdef __SSE2__
+/* 1 << v for each 32-bit lane, v in 1..9, by building the float 2^v */
+static inline __m128i one_hot(__m128i v) {
+    __m128i exponent = _mm_slli_epi32(_mm_add_epi32(v, _mm_set1_epi32(127)), 23);
+    return _mm_cvttps_epi32(_mm_castsi128_ps(exponent));
+}
+
+/* OR of lanes 0-2 */
+static inline unsigned or_three(__m128i v) {
+    v = _mm_or_si128(v, _mm_or_si128(_mm_srli_si128(v, 4), _mm_srli_si128(v, 8)));
+    return _mm_cvtsi128_si32(v);
+}
+
+int validate_grid(puzzle *p) {
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i nine = _mm_set1_epi32(9);
+    const __m128i all = _mm_set1_epi32(ALL_DIGITS);
+    __m128i left[9], right[9];
+    unsigned last[9];
+    __m128i bad = _mm_setzero_si128();
+
+    /* Columns 0-3 and 4-7 of each row as one-hot masks; column 8 is scalar */
+    for (int i = 0; i < 9; i++) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &p->content[i][0]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &p->content[i][4]);
+        int c = p->content[i][8];
+        bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmplt_epi32(a, one), _mm_cmpgt_epi32(a, nine)));
+        bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmplt_epi32(b, one), _mm_cmpgt_epi32(b, nine)));
+        if (c < 1 || c > 9) return 0;
+        left[i] = one_hot(a);
+        right[i] = one_hot(b);
+        last[i] = 1u << c;
+    }
+    if (_mm_movemask_epi8(bad)) return 0;
+
+    /* Columns: OR down the rows, all nine columns must see every digit */
+    __m128i column_left = left[0];
+    __m128i column_right = right[0];
+    unsigned column_last = last[0];
+    for (int i = 1; i < 9; i++) {
+        column_left = _mm_or_si128(column_left, left[i]);
+        column_right = _mm_or_si128(column_right, right[i]);
+        column_last |= last[i];
+    }
+    __m128i full = _mm_and_si128(_mm_cmpeq_epi32(column_left, all), _mm_cmpeq_epi32(column_right, all));
+    if (_mm_movemask_epi8(full) != 0xFFFF || column_last != ALL_DIGITS) return 0;
+
+    /* Rows: horizontal OR across the lanes */
+    for (int i = 0; i < 9; i++) {
+        __m128i m = _mm_or_si128(left[i], right[i]);
+        m = _mm_or_si128(m, _mm_shuffle_epi32(m, 0x4E));
+        m = _mm_or_si128(m, _mm_shuffle_epi32(m, 0xB1));
+        if ((_mm_cvtsi128_si32(m) | last[i]) != ALL_DIGITS) return 0;
+    }
+
+    /* Boxes: OR each band of three rows, then groups of three lanes */
+    for (int band = 0; band < 9; band += 3) {
+        __m128i a = _mm_or_si128(left[band], _mm_or_si128(left[band + 1], left[band + 2]));
+        __m128i b = _mm_or_si128(right[band], _mm_or_si128(right[band + 1], right[band + 2]));
+        unsigned c = last[band] | last[band + 1] | last[band + 2];
+        __m128i middle = _mm_or_si128(_mm_srli_si128(a, 12), _mm_slli_si128(b, 4));
+        if (or_three(a) != ALL_DIGITS
+            || or_three(middle) != ALL_DIGITS
+            || (or_three(_mm_srli_si128(b, 8)) | c) != ALL_DIGITS) {
+            return 0;
+        }
+    }
+    return 1;
+}
+#else
+int validate_grid(puzzle *p) {
+    unsigned rows[9] = {0}, cols[9] = {0}, boxes[9] = {0};
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            int number = p->content[i][j];
+            if (number < 1 || number > 9) return 0;
+            rows[i] |= 1u << number;
+            cols[j] |= 1u << number;
+            boxes[3 * (i / 3) + j / 3] |= 1u << number;
+        }
+    }
+    for (int i = 0; i < 9; i++) {
+        if (rows[i] != ALL_DIGITS || cols[i] != ALL_DIGITS || boxes[i] != ALL_DIGITS) return 0;
+    }
+    return 1;
+}
+#endif
+
+static void *validator_thread(void *argp) {
+    validator_args *args = argp;
+    puzzle *batch[BATCH_SIZE];
+
+    while (1) {
+        /* Take a batch of puzzles under the lock, then check them without it */
+        int count = 0;
+        pthread_mutex_lock(args->input_lock);
+        while (count < BATCH_SIZE && (batch[count] = read_next_puzzle(args->inputfile)) != NULL) {
+            count++;
+        }
+        pthread_mutex_unlock(args->input_lock);
+        if (count == 0) break;
+
+        for (int i = 0; i < count; i++) {
+            args->verified += validate_grid(batch[i]);
+            free(batch[i]);
+        }
+        args->total_puzzles += count;
+    }
+    return NULL;
+}
+
+void local_verify(FILE *inputfile, int num_threads, int *verified, int *total_puzzles) {
+    pthread_t tid[num_threads];
+    validator_args args[num_threads];
+    pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+
+    for (int i = 0; i < num_threads; i++) {
+        args[i].inputfile = inputfile;
+        args[i].input_lock = &input_lock;
+        args[i].verified = 0;
+        args[i].total_puzzles = 0;
+        pthread_create(&tid[i], NULL, validator_thread, &args[i]);
+    }
+
+    *verified = 0;
+    *total_puzzles = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(tid[i], NULL);
+        *verified += args[i].verified;
+        *total_puzzles += args[i].total_puzzles;
+    }
+}
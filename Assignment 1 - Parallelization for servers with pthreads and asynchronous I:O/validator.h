@@ -0,0 +1,13 @@
+#ifndef SUDOKU_VALIDATOR_H
+#define SUDOKU_VALIDATOR_H
+#include "common.h"
+
+/* Check that every row, column and box of p holds each digit 1-9 exactly once;
+ * returns 1 if yes, 0 if not */
+int validate_grid(puzzle *p);
+
+/* Validate every puzzle left in inputfile in-process on num_threads threads,
+ * counting the puzzles read and the ones that passed */
+void local_verify(FILE *inputfile, int num_threads, int *verified, int *total_puzzles);
+
+#endif //SUDOKU_VALIDATOR_H
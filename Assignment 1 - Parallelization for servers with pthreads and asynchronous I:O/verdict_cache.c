@@ -0,0 +1,139 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "verdict_cache.h"
+
+#define MAGIC 0x5644435355444F4BULL /* "KODUSCDV" */
+
+int verdict_cache_open(verdict_cache *cache, const char *filename) {
+    uint64_t capacity = VERDICT_CACHE_ENTRIES;
+    cache->size = sizeof(verdict_table) + capacity * sizeof(uint64_t);
+    cache->mapped = filename != NULL;
+
+    if (filename == NULL) {
+        cache->table = calloc(1, cache->size);
+        if (cache->table == NULL) {
+            printf("Unable to allocate the verdict cache.\n");
+            return -1;
+        }
+        cache->table->magic = MAGIC;
+        cache->table->capacity = capacity;
+        return 0;
+    }
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        printf("Unable to open cache file %s.\n", filename);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        /* A new file reads back as zeros: an empty table */
+        if (ftruncate(fd, cache->size) < 0) {
+            printf("Unable to size cache file %s.\n", filename);
+            close(fd);
+            return -1;
+        }
+    } else {
+        /* The probes mask with capacity - 1 and stop at a free word, so only
+         * the size this build creates, with free words left, is safe */
+        verdict_table header;
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != MAGIC
+            || header.capacity != capacity || header.count >= capacity
+            || (uint64_t) st.st_size != sizeof(verdict_table) + capacity * sizeof(uint64_t)) {
+            printf("%s is not a verdict cache.\n", filename);
+            close(fd);
+            return -1;
+        }
+        cache->size = st.st_size;
+    }
+
+    cache->table = mmap(NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (cache->table == MAP_FAILED) {
+        printf("Unable to map cache file %s.\n", filename);
+        return -1;
+    }
+    if (cache->table->magic != MAGIC) {
+        cache->table->capacity = capacity;
+        cache->table->magic = MAGIC;
+    }
+    return 0;
+}
+
+void verdict_cache_close(verdict_cache *cache) {
+    if (cache->mapped) {
+        msync(cache->table, cache->size, MS_SYNC);
+        munmap(cache->table, cache->size);
+    } else {
+        free(cache->table);
+    }
+}
+
+/* FNV-1a over the cells, finished with the murmur3 mixer so that the top
+ * bits, which pick the slot, depend on every cell */
+uint64_t verdict_cache_hash(puzzle *p) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 9; i++) {
+        for (int j = 0; j < 9; j++) {
+            hash ^= (uint64_t) p->content[i][j];
+            hash *= 0x100000001B3ULL;
+        }
+    }
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/* The word stored for hash, without its verdict bit; never 0 */
+static uint64_t key_of(uint64_t hash) {
+    uint64_t key = hash & ~1ULL;
+    return key != 0 ? key : 2;
+}
+
+int verdict_cache_lookup(verdict_cache *cache, uint64_t hash) {
+    verdict_table *table = cache->table;
+    uint64_t mask = table->capacity - 1;
+    uint64_t key = key_of(hash);
+    /* A file whose count understates how full it is may have no free word */
+    for (uint64_t i = hash >> 32; i < (hash >> 32) + table->capacity; i++) {
+        uint64_t entry = __atomic_load_n(&table->entries[i & mask], __ATOMIC_ACQUIRE);
+        if (entry == 0) {
+            return -1;
+        }
+        if ((entry & ~1ULL) == key) {
+            return entry & 1;
+        }
+    }
+    return -1;
+}
+
+void verdict_cache_insert(verdict_cache *cache, uint64_t hash, int verdict) {
+    verdict_table *table = cache->table;
+    uint64_t mask = table->capacity - 1;
+    uint64_t key = key_of(hash);
+    if (__atomic_load_n(&table->count, __ATOMIC_RELAXED) >= table->capacity / 4 * 3) {
+        return;
+    }
+    for (uint64_t i = hash >> 32; i < (hash >> 32) + table->capacity; i++) {
+        uint64_t *slot = &table->entries[i & mask];
+        uint64_t entry = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (entry == 0) {
+            if (__atomic_compare_exchange_n(slot, &entry, key | (verdict != 0), 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+                __atomic_fetch_add(&table->count, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            /* Lost the word to another insert; it may be the same grid */
+        }
+        if ((entry & ~1ULL) == key) {
+            return;
+        }
+    }
+}
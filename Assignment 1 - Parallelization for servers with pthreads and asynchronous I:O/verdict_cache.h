@@ -0,0 +1,43 @@
+#ifndef SUDOKU_VERDICT_CACHE_H
+#define SUDOKU_VERDICT_CACHE_H
+#include <stdio.h>
+#include <stdint.h>
+#include "common.h"
+
+/* Entries in every cache; a file of any other size is rejected */
+#define VERDICT_CACHE_ENTRIES (1 << 20)
+
+/* Verdicts of grids already verified, keyed by a 64-bit hash of the 81
+ * cells.  An open-addressing table of 64-bit words, each holding the top 63
+ * bits of the hash and the verdict in the low bit; 0 marks a free word.
+ * Words are claimed with a compare-and-swap, so any number of threads (or
+ * processes sharing the file) can look up and insert without a lock.  The
+ * table stops taking new grids once it is three quarters full */
+typedef struct {
+    uint64_t magic;
+    uint64_t capacity;          /* a power of two */
+    uint64_t count;
+    uint64_t entries[];
+} verdict_table;
+
+typedef struct {
+    verdict_table *table;
+    size_t size;                /* bytes mapped */
+    int mapped;                 /* table lives in a file */
+} verdict_cache;
+
+/* Back the cache with the file at filename, creating it if needed, or with
+ * memory if filename is NULL; returns -1 with a message printed on failure */
+int verdict_cache_open(verdict_cache *cache, const char *filename);
+
+/* Flush a file-backed cache to disk and release it */
+void verdict_cache_close(verdict_cache *cache);
+
+uint64_t verdict_cache_hash(puzzle *p);
+
+/* The cached verdict (0 or 1) for hash, or -1 if it is not cached */
+int verdict_cache_lookup(verdict_cache *cache, uint64_t hash);
+
+void verdict_cache_insert(verdict_cache *cache, uint64_t hash, int verdict);
+
+#endif //SUDOKU_VERDICT_CACHE_H
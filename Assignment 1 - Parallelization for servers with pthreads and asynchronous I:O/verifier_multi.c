@@ -1,46 +1,209 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <curl/curl.h>
 #include <getopt.h>
 #include "common.h"
+#include "validator.h"
+#include "json.h"
+#include "histogram.h"
+#include "puzzle_queue.h"
+#include "verdict_cache.h"
+#include "http_client.h"
 
 /* Check the common header for the definition of puzzle */
 
-#define URL "http://berkeley.uwaterloo.ca:4590/verify"
-#define ROW_LENGTH 20
-#define MATRIX_LENGTH 202
 #define MAX_WAIT_MSECS 30*1000 /* Wait max. 30 seconds */
-
-const char *ROW_FORMAT = "[%d,%d,%d,%d,%d,%d,%d,%d,%d]";
-const char *MATRIX_FORMAT = "{\"content\":[%s, %s, %s, %s, %s, %s, %s, %s, %s]}";
+#define MAX_BATCH_LATENCY 200 /* ms; adaptive batches shrink above this */
+#define LATENCY_SAMPLES 1024
+#define MIN_HEDGE_SAMPLES 32
+#define MAX_EVENTS 256
+#define QUEUE_CAPACITY 4096
+#define WINDOW_FLAT 1.1 /* round latency over the base below which -a grows the window */
+#define WINDOW_CONGESTED 1.5 /* and above which it shrinks it */
+#define WINDOW_MIN_ROUND 16 /* answers averaged per round at least */
+#define WINDOW_BASE_DECAY 16 /* rounds over which the base latency drifts up to the current one */
 
 int num_connections = 1;
+int local = 0;
+
+/* With -w N, N worker threads share the -t window, each with a multi handle,
+ * an epoll loop and a connection pool of its own; the main thread reads the
+ * input and hands the puzzles out through a lock-free queue */
+int num_workers = 1;
+puzzle_queue input_queue;
+
+/* With -2, speak HTTP/2 and multiplex every in-flight request as a stream
+ * over one connection.  Cleartext connections start with an Upgrade: h2c
+ * request; -P skips it (prior knowledge), but libcurl 7.88 fails every
+ * stream after the first on such connections.  A single connection also
+ * keeps 7.88 from sending HTTP/1.1 requests down a second connection while
+ * its upgrade is still pending */
+int h2 = 0;
+int prior_knowledge = 0;
+
+/* Connect, first byte and total time of every answered request */
+histogram connect_times;
+histogram ttfb_times;
+histogram total_times;
+
+/* Batch mode packs up to max_batch puzzles into one JSON array per request
+ * (-b); with -B each worker adapts its batch size to the observed latency */
+int max_batch = 0;
+int adaptive_batch = 0;
+int initial_batch = 1;
+
+/* A request that takes longer than request_timeout ms (-T) or fails is sent
+ * again up to max_retries times (-r) after a jittered exponential backoff */
+long request_timeout = REQUEST_TIMEOUT_MS;
+int max_retries = MAX_RETRIES;
+
+/* With -h P, a request still unanswered after the observed p95 latency is
+ * duplicated and the first answer wins, as long as the duplicates stay
+ * within P percent of the requests sent */
+int hedge_budget = 0;
+
+/* With -a, each worker sizes its window like TCP Vegas, with -t as the
+ * ceiling: the window doubles every round trip until latency first rises,
+ * then grows by one a round trip while latency stays flat or throughput
+ * still rises, shrinks by a quarter once requests queue at the server and
+ * halves when a request times out, fails to connect or gets a 503 */
+int adaptive_window = 0;
+
+/* With -c, verdicts are remembered by the hash of the grid and repeated
+ * grids never reach the network; -C file keeps them in a file mapped into
+ * memory, so that they carry over to later runs */
+int use_cache = 0;
+const char *cache_filename = NULL;
+verdict_cache cache;
+
+/* One in-flight request.  Slots and their easy handles live for the whole
+ * run; only the body changes between requests, so connections are reused */
+typedef struct request_slot {
+    CURL *eh;
+    int result;
+    char *json;                 /* request body, allocated once per slot */
+    long length;                /* bytes of json to send */
+    int count;                  /* puzzles in the request */
+    uint64_t *hashes;           /* of each puzzle, for the verdict cache */
+    char *response;             /* batch verdicts received so far */
+    size_t response_length;
+    double sent;                /* send time in ms */
+    int running;                /* added to the multi handle */
+    int attempts;               /* failed attempts so far */
+    double retry_at;            /* ms; when a failed request goes out again, 0 if not waiting */
+    int hedge;                  /* this is the duplicate of a slow request */
+    int abandoned;              /* lost a hedge race on HTTP/2; the answer is ignored */
+    struct request_slot *twin;  /* the other copy of a hedged request */
+} request_slot;
+
+/* The epoll loop behind curl_multi_socket_action: curl tells us which
+ * sockets to watch and when it next needs a timeout action */
+typedef struct {
+    CURLM *cm;
+    int epfd;
+    double timer_deadline;      /* ms; 0 when curl has no timeout pending */
+} event_loop;
+
+/* One worker thread: its share of the window, the state behind hedging and
+ * adaptive batches, and the counts merged by the main thread at the end */
+typedef struct {
+    int window;                 /* requests kept in flight */
+    int max_window;             /* this worker's share of -t */
+    double base_rtt;            /* ms; lowest recent round latency */
+    double rtt;                 /* ms; mean latency of the last round */
+    double round_start;         /* ms */
+    double round_latency;
+    double round_throughput;    /* answers per ms in the last round */
+    int round_requests;
+    int slow_start;
+    double last_decrease;       /* ms; when the window was last halved */
+    int batch_size;
+    double latencies[LATENCY_SAMPLES];
+    int num_latencies;
+    double p95;
+    double adapt_start;         /* ms; start of the current adaptive batch window */
+    double adapt_latency;
+    double last_throughput;
+    int adapt_puzzles;
+    int adapt_requests;
+    int total_puzzles;
+    int verified;
+    int requests;
+    int retries;
+    int failed;
+    int hedges;
+    int hedge_wins;
+    int cache_hits;
+    int cache_misses;
+} worker_args;
 
 FILE *inputfile;
 
-/* Create cURL easy handle and configure it */
-CURL *create_eh(const int *result_code, const char *json_to_send, const struct curl_slist *headers);
+/* cURL write callback for batch responses */
+size_t batch_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata);
+
+/* Load the next queued puzzles into the slot's request; returns how many
+ * were taken */
+int fill_slot(worker_args *w, request_slot *slot);
+
+/* Answer puzzles from the cache until one misses; returns it, or NULL once
+ * the queue is empty */
+puzzle *next_uncached(worker_args *w);
+
+/* Count the puzzles of a finished request that passed verification, and
+ * cache their verdicts if remember is set */
+int collect_slot(worker_args *w, request_slot *slot, int remember);
+
+/* (Re)send the request held in slot */
+void start_request(CURLM *cm, request_slot *slot);
+
+/* Copy the request in slot into copy, ready to be sent as a hedge */
+void copy_request(request_slot *slot, request_slot *copy);
+
+/* Add the timings curl measured for a finished transfer to the histograms */
+void record_timings(CURL *eh);
+
+/* Print the request rate and the latency percentiles */
+void print_timings(int puzzles, double elapsed);
 
-/* Configure headers for the cURL request */
-struct curl_slist *config_headers();
+/* Add the latency of a successful request to the samples behind p95 */
+void record_latency(worker_args *w, double latency);
 
-/* Transform the puzzle into an appropriate json format for the server */
-char *convert_to_json(puzzle *p);
+/* Move the window after a request answered in latency ms, or failed from
+ * overload */
+void adapt_window(worker_args *w, double latency, int failed);
 
-/* cURL read callback */
-size_t read_callback(char *buffer, size_t size, size_t nitems, void *userdata);
+/* Grow or shrink the batch size after a batch of count puzzles took latency ms */
+void adapt_batch(worker_args *w, int count, double latency);
 
-/* cURL write callback */
-size_t write_callback(char *ptr, size_t size, size_t nmemb, void *userdata);
+/* curl socket callback: mirror the sockets curl wants watched into epoll */
+int socket_callback(CURL *eh, curl_socket_t s, int what, void *userp, void *socketp);
 
+/* curl timer callback: remember when curl next needs a timeout action */
+int timer_callback(CURLM *cm, long timeout_ms, void *userp);
+
+/* Hand the ready sockets, and an expired curl timer, to curl */
+void run_events(event_loop *loop, int timeout);
+
+/* Start the workers, feed them the input and print the merged results */
 void multi_verify();
 
+void *verify_worker(void *argp);
+
 int main(int argc, char **argv) {
     /* Parse arguments */
     int c;
     char* filename = NULL;
-    while ((c = getopt(argc, argv, "t:i:")) != -1) {
+    while ((c = getopt(argc, argv, "t:i:lu:b:B:T:r:h:v2Pw:acC:")) != -1) {
         switch (c) {
             case 't':
                 num_connections = strtoul(optarg, NULL, 10);
@@ -52,6 +215,57 @@ int main(int argc, char **argv) {
             case 'i':
                 filename = optarg;
                 break;
+            case 'l':
+                local = 1;
+                break;
+            case 'u':
+                url = optarg;
+                break;
+            case 'B':
+                adaptive_batch = 1;
+                /* fall through */
+            case 'b':
+                max_batch = strtoul(optarg, NULL, 10);
+                if (max_batch == 0) {
+                    printf("%s: option requires an argument > 0 -- '%c'\n", argv[0], c);
+                    return EXIT_FAILURE;
+                }
+                initial_batch = adaptive_batch ? 1 : max_batch;
+                break;
+            case 'T':
+                request_timeout = strtol(optarg, NULL, 10);
+                break;
+            case 'r':
+                max_retries = strtoul(optarg, NULL, 10);
+                break;
+            case 'h':
+                hedge_budget = strtoul(optarg, NULL, 10);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case '2':
+                h2 = 1;
+                break;
+            case 'P':
+                prior_knowledge = 1;
+                break;
+            case 'a':
+                adaptive_window = 1;
+                break;
+            case 'C':
+                cache_filename = optarg;
+                /* fall through */
+            case 'c':
+                use_cache = 1;
+                break;
+            case 'w':
+                num_workers = strtoul(optarg, NULL, 10);
+                if (num_workers == 0) {
+                    printf("%s: option requires an argument > 0 -- 'w'\n", argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 return -1;
         }
@@ -64,188 +278,649 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    curl_global_init(CURL_GLOBAL_ALL);
-
     /* Check puzzles */
-    multi_verify();
+    if (local) {
+        /* In-process check; -t is the number of validator threads */
+        int verified, total_puzzles;
+        local_verify(inputfile, num_connections, &verified, &total_puzzles);
+        printf("%d of %d puzzles passed verification.\n", verified, total_puzzles);
+    } else {
+        curl_global_init(CURL_GLOBAL_ALL);
+        srand(time(NULL));
+        multi_verify();
+        curl_global_cleanup();
+    }
 
-    curl_global_cleanup();
     fclose( inputfile );
     return 0;
 }
 
 void multi_verify() {
-    CURLM *cm = curl_multi_init();
-
-    char *converted;
-    struct curl_slist *headers_list[num_connections];
-
-    int total_puzzles = 0;
-    int verified = 0;
-    int still_running = 0;
+    // Every connection needs a descriptor; lift the soft limit as far as allowed
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
 
-    CURL *eh;
+    // Each worker needs at least one request in flight
+    if (num_workers > num_connections) {
+        num_workers = num_connections;
+    }
+    if (puzzle_queue_init(&input_queue, QUEUE_CAPACITY) < 0) {
+        printf("Unable to allocate the input queue.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (use_cache && verdict_cache_open(&cache, cache_filename) < 0) {
+        exit(EXIT_FAILURE);
+    }
 
-    int results[num_connections];
-    int idx = 0;
+    double start = now_ms();
+    pthread_t tid[num_workers];
+    worker_args args[num_workers];
+    for (int i = 0; i < num_workers; i++) {
+        memset(&args[i], 0, sizeof(worker_args));
+        args[i].max_window = num_connections / num_workers + (i < num_connections % num_workers);
+        args[i].window = adaptive_window ? 1 : args[i].max_window;
+        args[i].slow_start = 1;
+        args[i].batch_size = initial_batch;
+        pthread_create(&tid[i], NULL, verify_worker, &args[i]);
+    }
 
+    // Parsing is cheap next to a request, so one reader keeps the workers
+    // fed; when the queue is full it yields to them
     puzzle *p;
-
-    // Read in the puzzle one by one
     while ((p = read_next_puzzle(inputfile)) != NULL) {
-        total_puzzles ++;
-
-        converted = convert_to_json(p);
-        headers_list[idx] = config_headers();
-
-        // Initalize the easy handle and pass in the result pointer and header pointer
-        eh = create_eh(&results[idx], converted, headers_list[idx]);
-        // Add easy handle to the multi handle
-        curl_multi_add_handle( cm, eh );
-
-        // If the number of easy handle reaches num_connections, we dispatch them all at once with curl_multi_perform
-        if (idx == num_connections - 1) {
-            curl_multi_perform(cm, &still_running);
-            do {
-                int numfds = 0;
-                int res = curl_multi_wait(cm, NULL, 0, MAX_WAIT_MSECS, &numfds);
-                if (res != CURLM_OK) {
-                    return exit(EXIT_FAILURE);
-                }
+        while (!puzzle_queue_push(&input_queue, p)) {
+            sched_yield();
+        }
+    }
+    puzzle_queue_close(&input_queue);
+
+    worker_args total;
+    memset(&total, 0, sizeof(worker_args));
+    double p95 = 0;
+    int batch_size = 0;
+    int window = 0;
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(tid[i], NULL);
+        total.total_puzzles += args[i].total_puzzles;
+        total.verified += args[i].verified;
+        total.requests += args[i].requests;
+        total.retries += args[i].retries;
+        total.failed += args[i].failed;
+        total.hedges += args[i].hedges;
+        total.hedge_wins += args[i].hedge_wins;
+        total.cache_hits += args[i].cache_hits;
+        total.cache_misses += args[i].cache_misses;
+        p95 += args[i].p95 / num_workers;
+        batch_size += args[i].batch_size;
+        window += args[i].window;
+    }
+    puzzle_queue_destroy(&input_queue);
 
-                curl_multi_perform(cm, &still_running);
-            } while (still_running);
-            
-            // When still_running = 0 and all the request are finished
-            // We collect all the result from the result array
-            for (int i = 0; i < num_connections; i++) {
-                verified += results[i];
-                results[i] = 0;
-                curl_slist_free_all(headers_list[i]);
-            } 
+    // Print the final result
+    printf("%d of %d puzzles passed verification.\n", total.verified, total.total_puzzles);
+    print_timings(total.total_puzzles, (now_ms() - start) / 1e3);
 
-            idx = 0;
-        } else {
-            idx ++;
-        }
+    if (total.retries > 0) {
+        printf("Retried %d requests; %d puzzles failed for good.\n", total.retries, total.failed);
+    }
+    if (hedge_budget > 0) {
+        printf("Hedged %d of %d requests (p95 %.1f ms); %d hedges answered first.\n",
+            total.hedges, total.requests, p95, total.hedge_wins);
+    }
+    if (use_cache) {
+        int lookups = total.cache_hits + total.cache_misses;
+        printf("Cache: %d hits, %d misses (%.1f%% hit rate); %lu grids cached.\n",
+            total.cache_hits, total.cache_misses, lookups > 0 ? 100.0 * total.cache_hits / lookups : 0.0,
+            (unsigned long) cache.table->count);
+        verdict_cache_close(&cache);
+    }
+    if (adaptive_window) {
+        printf("Window settled at %d of at most %d requests in flight.\n", window, num_connections);
+    }
+    if (adaptive_batch) {
+        printf("Batch size settled at %d puzzles per request.\n",
+            (batch_size + num_workers / 2) / num_workers);
+    }
+}
 
-        free(p);
+void *verify_worker(void *argp) {
+    worker_args *w = argp;
+    // Hedges get slots of their own so they never shrink the window
+    int hedge_slots = hedge_budget > 0 ? (w->max_window * hedge_budget + 99) / 100 : 0;
+    int pool = w->max_window + hedge_slots;
+    CURLM *cm = curl_multi_init();
+    curl_multi_setopt(cm, CURLMOPT_MAXCONNECTS, (long) pool);
+    if (h2) {
+        curl_multi_setopt(cm, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(cm, CURLMOPT_MAX_CONCURRENT_STREAMS, (long) pool);
+        // Until the first response shows the server multiplexes, every
+        // waiting transfer would open its own connection
+        curl_multi_setopt(cm, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
     }
-    
-    // Similary to above. Handling what left in the multi handlers
-    if (idx > 0) {
-        curl_multi_perform(cm, &still_running);
-        do {
-            int numfds = 0;
-            int res = curl_multi_wait(cm, NULL, 0, MAX_WAIT_MSECS, &numfds);
-            if (res != CURLM_OK) {
-                return exit(EXIT_FAILURE);
-            }
 
-            curl_multi_perform(cm, &still_running);
-        } while (still_running);
-        
-        for (int i = 0; i < idx; i++) {
-            verified += results[i];
-            results[i] = 0;
-            curl_slist_free_all(headers_list[i]);
-        } 
+    // Only the sockets epoll reports ready are handed to curl, so the cost
+    // of an event does not grow with the number of connections
+    event_loop loop = { cm, epoll_create1(0), 0 };
+    curl_multi_setopt(cm, CURLMOPT_SOCKETFUNCTION, socket_callback);
+    curl_multi_setopt(cm, CURLMOPT_SOCKETDATA, &loop);
+    curl_multi_setopt(cm, CURLMOPT_TIMERFUNCTION, timer_callback);
+    curl_multi_setopt(cm, CURLMOPT_TIMERDATA, &loop);
+
+    // Every request shares one header list and one persistent handle per slot
+    struct curl_slist *headers = config_headers();
+    request_slot slots[pool];
+    request_slot *free_slots[pool];
+    int num_free = pool;
+    for (int i = 0; i < pool; i++) {
+        // The body is encoded into, and sent straight from, the slot's buffer
+        slots[i].json = malloc(max_batch > 0 ? max_batch * MATRIX_LENGTH + 2 : MATRIX_LENGTH);
+        slots[i].length = MATRIX_LENGTH;
+        slots[i].eh = create_eh(&slots[i].result, slots[i].json, headers);
+        curl_easy_setopt(slots[i].eh, CURLOPT_TIMEOUT_MS, request_timeout);
+        if (h2) {
+            curl_easy_setopt(slots[i].eh, CURLOPT_HTTP_VERSION, prior_knowledge
+                             ? (long) CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE : (long) CURL_HTTP_VERSION_2_0);
+            // Queue behind an existing connection instead of opening another
+            curl_easy_setopt(slots[i].eh, CURLOPT_PIPEWAIT, 1L);
+        }
+        slots[i].response = NULL;
+        slots[i].hashes = malloc((max_batch > 0 ? max_batch : 1) * sizeof(uint64_t));
+        if (max_batch > 0) {
+            slots[i].response = malloc(2 * max_batch + 64);
+            curl_easy_setopt(slots[i].eh, CURLOPT_WRITEFUNCTION, batch_write_callback);
+            curl_easy_setopt(slots[i].eh, CURLOPT_WRITEDATA, &slots[i]);
+        }
+        curl_easy_setopt(slots[i].eh, CURLOPT_PRIVATE, &slots[i]);
+        slots[i].running = 0;
+        slots[i].abandoned = 0;
+        slots[i].retry_at = 0;
+        slots[i].twin = NULL;
+        free_slots[i] = &slots[i];
     }
 
+    int in_flight = 0;          /* unanswered requests, including those waiting to retry */
+    int waiting = 0;            /* failed requests waiting out their backoff */
+    int input_done = 0;
+    int hedges_in_flight = 0;
+
+    CURL *eh;
     CURLMsg *msg = NULL;
     int msgs_left = 0;
-    
-    // Check the message, return code and response code for each requests
-    while ((msg = curl_multi_info_read(cm, &msgs_left))) {
-        if (msg->msg == CURLMSG_DONE) {
+
+    while (1) {
+        // Keep the window full: start a request for every free slot.  The
+        // drained check comes first so no puzzle is pushed after it
+        int starved = 0;
+        while (!input_done && in_flight < w->window) {
+            int drained = puzzle_queue_drained(&input_queue);
+            request_slot *slot = free_slots[num_free - 1];
+            int count = fill_slot(w, slot);
+            if (count == 0) {
+                input_done = drained;
+                starved = !drained;
+                break;
+            }
+            w->total_puzzles += count;
+            num_free --;
+
+            slot->attempts = 0;
+            slot->hedge = 0;
+            start_request(cm, slot);
+            in_flight ++;
+            w->requests ++;
+        }
+
+        if (in_flight == 0 && input_done) {
+            break;
+        }
+
+        // Resend failed requests whose backoff is over and hedge slow ones;
+        // while the reader falls behind, look at the queue again soon
+        double now = now_ms();
+        double wake = now + (starved ? 1 : MAX_WAIT_MSECS);
+        if (waiting > 0 || (hedge_budget > 0 && w->p95 > 0)) {
+            for (int i = 0; i < pool; i++) {
+                request_slot *slot = &slots[i];
+                if (slot->retry_at > 0) {
+                    if (slot->retry_at > now) {
+                        wake = slot->retry_at < wake ? slot->retry_at : wake;
+                        continue;
+                    }
+                    slot->retry_at = 0;
+                    slot->result = 0;
+                    slot->response_length = 0;
+                    start_request(cm, slot);
+                    waiting --;
+                } else if (hedge_budget > 0 && w->p95 > 0 && slot->running && !slot->abandoned && slot->twin == NULL) {
+                    if (slot->sent + w->p95 > now) {
+                        wake = slot->sent + w->p95 < wake ? slot->sent + w->p95 : wake;
+                        continue;
+                    }
+                    if (hedges_in_flight == hedge_slots || w->hedges * 100 >= hedge_budget * w->requests) {
+                        continue;
+                    }
+                    request_slot *copy = free_slots[--num_free];
+                    copy_request(slot, copy);
+                    start_request(cm, copy);
+                    w->hedges ++;
+                    hedges_in_flight ++;
+                }
+            }
+        }
+
+        // Sleep until a socket is ready, curl's timer expires, a retry is
+        // due or a request becomes slow enough to hedge
+        if (loop.timer_deadline > 0 && loop.timer_deadline < wake) {
+            wake = loop.timer_deadline;
+        }
+        double remaining = wake - now_ms();
+        run_events(&loop, remaining > 0 ? (int) remaining + 1 : 0);
+
+        // Reap every finished transfer straight away so its slot can be reused
+        while ((msg = curl_multi_info_read(cm, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                printf("Error after curl multi info read(), CURLMsg=%d\n", msg->msg);
+                continue;
+            }
             eh = msg->easy_handle;
+            request_slot *slot;
+            curl_easy_getinfo(eh, CURLINFO_PRIVATE, (char **) &slot);
+            curl_multi_remove_handle(cm, eh);
+            slot->running = 0;
+
+            if (slot->abandoned) {
+                slot->abandoned = 0;
+                free_slots[num_free++] = slot;
+                hedges_in_flight --;
+                continue;
+            }
 
             CURLcode res = msg->data.result;
-            if (res != CURLE_OK) {
-                printf("Error occurred in executing the cURL request: %s\n",
-                    curl_easy_strerror(res));
-                exit(EXIT_FAILURE);
+            long response_code = 0;
+            if (res == CURLE_OK) {
+                curl_easy_getinfo(eh, CURLINFO_RESPONSE_CODE, &response_code);
+            }
+
+            // Timeouts, connection errors and server errors are worth another try
+            if (res != CURLE_OK || response_code >= 500) {
+                if (res != CURLE_OK) {
+                    printf("Error occurred in executing the cURL request: %s\n",
+                        curl_easy_strerror(res));
+                } else {
+                    printf("Error in HTTP request; HTTP code %lu received.\n", response_code);
+                }
+                // A random server error says nothing about load; timeouts,
+                // refused connections and 503 do
+                if (adaptive_window && (res != CURLE_OK || response_code == 503)) {
+                    adapt_window(w, 0, 1);
+                }
+                if (slot->twin != NULL) {
+                    // The other copy is still out and may yet answer
+                    slot->twin->twin = NULL;
+                    slot->twin = NULL;
+                    hedges_in_flight --;
+                    free_slots[num_free++] = slot;
+                } else if (slot->attempts < max_retries) {
+                    slot->attempts ++;
+                    slot->retry_at = now_ms() + backoff_ms(slot->attempts);
+                    waiting ++;
+                    w->retries ++;
+                } else {
+                    printf("Giving up on a request for %d puzzles after %d attempts.\n",
+                        slot->count, slot->attempts + 1);
+                    w->failed += slot->count;
+                    free_slots[num_free++] = slot;
+                    in_flight --;
+                }
+                continue;
             }
 
-            long response_code;
-            curl_easy_getinfo(eh, CURLINFO_RESPONSE_CODE, &response_code);
             if (response_code != 200) {
                 printf("Error in HTTP request; HTTP code %lu received.\n", response_code);
             }
 
-            curl_multi_remove_handle(cm, eh);
-            curl_easy_cleanup(eh);
-        } else {
-            printf("Error after curl multi info read(), CURLMsg=%d\n", msg->msg);
+            double latency = now_ms() - slot->sent;
+            if (hedge_budget > 0) {
+                record_latency(w, latency);
+            }
+            if (adaptive_window) {
+                adapt_window(w, latency, 0);
+            }
+            record_timings(eh);
+            w->verified += collect_slot(w, slot, use_cache && response_code == 200);
+
+            // First answer wins; cancel the other copy of a hedged request.
+            // On HTTP/2 it is left to finish instead: with libcurl 7.88,
+            // resetting one stream can stall the others on its connection
+            if (slot->twin != NULL) {
+                request_slot *twin = slot->twin;
+                twin->twin = NULL;
+                slot->twin = NULL;
+                w->hedge_wins += slot->hedge;
+                if (h2) {
+                    twin->abandoned = 1;
+                } else {
+                    curl_multi_remove_handle(cm, twin->eh);
+                    twin->running = 0;
+                    free_slots[num_free++] = twin;
+                    hedges_in_flight --;
+                }
+            }
+            free_slots[num_free++] = slot;
+            in_flight --;
         }
     }
 
-    // Print the final result
-    printf("%d of %d puzzles passed verification.\n", verified, total_puzzles);
-
+    for (int i = 0; i < pool; i++) {
+        curl_easy_cleanup(slots[i].eh);
+        free(slots[i].json);
+        free(slots[i].response);
+        free(slots[i].hashes);
+    }
+    curl_slist_free_all(headers);
     curl_multi_cleanup(cm);
+    close(loop.epfd);
+    return NULL;
 }
 
-char *convert_to_json(puzzle *p) {
-    char *rows[9];
-    for (int i = 0; i < 9; i++) {
-        rows[i] = malloc(ROW_LENGTH);
-        memset(rows[i], 0, ROW_LENGTH);
-        int written = sprintf(rows[i], ROW_FORMAT,
-                              p->content[i][0], p->content[i][1], p->content[i][2],
-                              p->content[i][3], p->content[i][4], p->content[i][5],
-                              p->content[i][6], p->content[i][7], p->content[i][8]);
-        if (written != ROW_LENGTH - 1) {
-            printf("Something went wrong when writing row; expected to write %d but wrote %d...\n",
-                    ROW_LENGTH -1, written);
-        }
+int socket_callback(CURL *eh, curl_socket_t s, int what, void *userp, void *socketp) {
+    event_loop *loop = userp;
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, s, NULL);
+        return 0;
     }
-    char *json = malloc(MATRIX_LENGTH);
-    memset(json, 0, MATRIX_LENGTH);
-    int written = sprintf(json, MATRIX_FORMAT,
-                          rows[0], rows[1], rows[2], rows[3], rows[4],
-                          rows[5], rows[6], rows[7], rows[8]);
-    if (written != MATRIX_LENGTH - 1) {
-        printf("Something went wrong when writing matrix; expected to write %d but wrote %d...\n",
-               MATRIX_LENGTH -1, written);
+
+    struct epoll_event ev;
+    ev.events = (what & CURL_POLL_IN ? EPOLLIN : 0) | (what & CURL_POLL_OUT ? EPOLLOUT : 0);
+    ev.data.fd = s;
+    // socketp is set once curl has seen us register the socket
+    if (socketp == NULL) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, s, &ev);
+        curl_multi_assign(loop->cm, s, loop);
+    } else {
+        epoll_ctl(loop->epfd, EPOLL_CTL_MOD, s, &ev);
     }
-    for (int i = 0; i < 9; i++) {
-        free(rows[i]);
+    return 0;
+}
+
+int timer_callback(CURLM *cm, long timeout_ms, void *userp) {
+    event_loop *loop = userp;
+    loop->timer_deadline = timeout_ms < 0 ? 0 : now_ms() + timeout_ms;
+    return 0;
+}
+
+void run_events(event_loop *loop, int timeout) {
+    struct epoll_event events[MAX_EVENTS];
+    int still_running;
+
+    int ready = epoll_wait(loop->epfd, events, MAX_EVENTS, timeout);
+    for (int i = 0; i < ready; i++) {
+        int flags = (events[i].events & EPOLLIN ? CURL_CSELECT_IN : 0)
+                  | (events[i].events & EPOLLOUT ? CURL_CSELECT_OUT : 0)
+                  | (events[i].events & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0);
+        curl_multi_socket_action(loop->cm, events[i].data.fd, flags, &still_running);
+    }
+
+    if (loop->timer_deadline > 0 && now_ms() >= loop->timer_deadline) {
+        // The callback may set a new deadline while curl handles this one
+        loop->timer_deadline = 0;
+        curl_multi_socket_action(loop->cm, CURL_SOCKET_TIMEOUT, 0, &still_running);
     }
-    return json;
 }
 
-size_t read_callback(char *buffer, size_t size, size_t nitems, void *userdata) {
-    memcpy(buffer, userdata, MATRIX_LENGTH);
-    free(userdata);
-    return MATRIX_LENGTH;
+void start_request(CURLM *cm, request_slot *slot) {
+    slot->sent = now_ms();
+    slot->running = 1;
+    curl_multi_add_handle( cm, slot->eh );
+}
+
+void copy_request(request_slot *slot, request_slot *copy) {
+    memcpy(copy->json, slot->json, slot->length);
+    memcpy(copy->hashes, slot->hashes, slot->count * sizeof(uint64_t));
+    copy->length = slot->length;
+    copy->count = slot->count;
+    copy->result = 0;
+    copy->response_length = 0;
+    copy->attempts = slot->attempts;
+    copy->hedge = 1;
+    curl_easy_setopt(copy->eh, CURLOPT_POSTFIELDSIZE, copy->length);
+    slot->twin = copy;
+    copy->twin = slot;
 }
 
-size_t write_callback(char *ptr, size_t size, size_t nmemb, void  *userdata) {
-    printf("Write callback message from server: %s\n", ptr);
-    int * p = (int*) userdata;
-    *p = atoi(ptr);
-    return size * nmemb;
+void record_timings(CURL *eh) {
+    curl_off_t connect, ttfb, total;
+    curl_easy_getinfo(eh, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(eh, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(eh, CURLINFO_TOTAL_TIME_T, &total);
+    histogram_record(&connect_times, connect);
+    histogram_record(&ttfb_times, ttfb);
+    histogram_record(&total_times, total);
 }
 
-struct curl_slist *config_headers() {
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    headers = curl_slist_append(headers, "Expect:");
-    return headers;
+void print_timings(int puzzles, double elapsed) {
+    unsigned long answered = total_times.total;
+    printf("%lu requests in %.3f s: %.1f requests/s, %.1f puzzles/s\n",
+        answered, elapsed, answered / elapsed, puzzles / elapsed);
+    // Reused connections report a connect time of 0
+    printf("%-8s %10s %10s %10s %10s\n", "ms", "p50", "p90", "p99", "max");
+    histogram_print(&connect_times, "connect", stdout);
+    histogram_print(&ttfb_times, "ttfb", stdout);
+    histogram_print(&total_times, "total", stdout);
 }
 
-CURL *create_eh(const int *result, const char *json_to_send, const struct curl_slist *headers) {
-    CURL *eh = curl_easy_init();
-    curl_easy_setopt(eh, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(eh, CURLOPT_URL, URL);
-    curl_easy_setopt(eh, CURLOPT_POST, 1L);
-    curl_easy_setopt(eh, CURLOPT_READFUNCTION, read_callback);
-    curl_easy_setopt(eh, CURLOPT_READDATA, json_to_send);
-    curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(eh, CURLOPT_WRITEDATA, result);
-    curl_easy_setopt(eh, CURLOPT_POSTFIELDSIZE, MATRIX_LENGTH);
-    return eh;
+int compare_latency(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
 }
 
+/*
+ * Keep the last LATENCY_SAMPLES latencies and refresh p95 from them every
+ * MIN_HEDGE_SAMPLES responses; hedging starts once the first estimate exists.
+ */
+void record_latency(worker_args *w, double latency) {
+    w->latencies[w->num_latencies++ % LATENCY_SAMPLES] = latency;
+    if (w->num_latencies % MIN_HEDGE_SAMPLES != 0) {
+        return;
+    }
+    int n = w->num_latencies < LATENCY_SAMPLES ? w->num_latencies : LATENCY_SAMPLES;
+    double sorted[LATENCY_SAMPLES];
+    memcpy(sorted, w->latencies, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_latency);
+    w->p95 = sorted[n * 95 / 100];
+}
+
+int fill_slot(worker_args *w, request_slot *slot) {
+    puzzle *p;
+    slot->result = 0;
+    slot->count = 0;
+
+    if (max_batch == 0) {
+        if ((p = next_uncached(w)) == NULL) {
+            return 0;
+        }
+        slot->hashes[0] = use_cache ? verdict_cache_hash(p) : 0;
+        encode_puzzle(p, slot->json);
+        slot->count = 1;
+        free(p);
+        return 1;
+    }
+
+    // Batch: [{"content":...},{"content":...},...] without the NUL terminators
+    char *body = slot->json;
+    *body++ = '[';
+    while (slot->count < w->batch_size && (p = next_uncached(w)) != NULL) {
+        if (slot->count > 0) {
+            *body++ = ',';
+        }
+        slot->hashes[slot->count] = use_cache ? verdict_cache_hash(p) : 0;
+        // The NUL the encoder leaves behind is overwritten by ',' or ']'
+        encode_puzzle(p, body);
+        body += MATRIX_LENGTH - 1;
+        slot->count ++;
+        free(p);
+    }
+    if (slot->count == 0) {
+        return 0;
+    }
+    *body++ = ']';
+    slot->response_length = 0;
+    slot->length = body - slot->json;
+    curl_easy_setopt(slot->eh, CURLOPT_POSTFIELDSIZE, slot->length);
+    return slot->count;
+}
 
+puzzle *next_uncached(worker_args *w) {
+    puzzle *p;
+    while ((p = puzzle_queue_pop(&input_queue)) != NULL) {
+        if (!use_cache) {
+            return p;
+        }
+        int verdict = verdict_cache_lookup(&cache, verdict_cache_hash(p));
+        if (verdict < 0) {
+            w->cache_misses ++;
+            return p;
+        }
+        w->cache_hits ++;
+        w->total_puzzles ++;
+        w->verified += verdict;
+        free(p);
+    }
+    return NULL;
+}
+
+int collect_slot(worker_args *w, request_slot *slot, int remember) {
+    if (max_batch == 0) {
+        if (remember) {
+            verdict_cache_insert(&cache, slot->hashes[0], slot->result == 1);
+        }
+        return slot->result;
+    }
+
+    if (adaptive_batch) {
+        adapt_batch(w, slot->count, now_ms() - slot->sent);
+    }
+
+    // The response is an array with one 0/1 verdict per puzzle, in order
+    int verdicts = 0;
+    int passed = 0;
+    slot->response[slot->response_length] = '\0';
+    for (char *c = slot->response; *c != '\0'; c++) {
+        if (*c == '0' || *c == '1') {
+            passed += *c - '0';
+            verdicts ++;
+        }
+    }
+    // Only a complete answer can be matched up with the grids
+    if (remember && verdicts == slot->count) {
+        int i = 0;
+        for (char *c = slot->response; *c != '\0'; c++) {
+            if (*c == '0' || *c == '1') {
+                verdict_cache_insert(&cache, slot->hashes[i++], *c - '0');
+            }
+        }
+    }
+    if (verdicts != slot->count) {
+        printf("Batch of %d puzzles got %d verdicts back: %s\n", slot->count, verdicts, slot->response);
+    }
+    return passed;
+}
+
+/*
+ * A round is one window of answers, and at least WINDOW_MIN_ROUND so that
+ * jitter averages out.  Vegas takes the lowest round latency as the cost of
+ * a request that did not queue; a round well above it means the window is
+ * filling a queue at the server rather than the link.  The base drifts up
+ * slowly so that one lucky round is not the yardstick forever.
+ */
+void adapt_window(worker_args *w, double latency, int failed) {
+    double now = now_ms();
+    if (w->round_start == 0) {
+        w->round_start = now - latency;
+    }
+    if (failed) {
+        // Halve at most once a round trip; one overload fails many requests
+        if (now - w->last_decrease > w->rtt) {
+            w->window = w->window / 2 > 1 ? w->window / 2 : 1;
+            w->slow_start = 0;
+            w->last_decrease = now;
+            w->round_start = now;
+            w->round_latency = 0;
+            w->round_requests = 0;
+        }
+        return;
+    }
+
+    w->round_latency += latency;
+    if (++w->round_requests < w->window || w->round_requests < WINDOW_MIN_ROUND) {
+        return;
+    }
+
+    w->rtt = w->round_latency / w->round_requests;
+    if (w->base_rtt == 0 || w->rtt < w->base_rtt) {
+        w->base_rtt = w->rtt;
+    } else {
+        // Forget a lucky round; the server may also have become slower
+        w->base_rtt += (w->rtt - w->base_rtt) / WINDOW_BASE_DECAY;
+    }
+    double throughput = w->round_requests / (now - w->round_start);
+    if (w->rtt > w->base_rtt * WINDOW_CONGESTED) {
+        w->window -= w->window / 4;
+        w->slow_start = 0;
+    } else if (w->rtt <= w->base_rtt * WINDOW_FLAT || throughput > w->round_throughput) {
+        // As TCP: one more per answer in slow start, one per window after
+        int growth = w->slow_start ? w->round_requests : w->round_requests / w->window;
+        w->window += growth > 1 ? growth : 1;
+    } else {
+        w->slow_start = 0;
+    }
+    if (w->window > w->max_window) {
+        w->window = w->max_window;
+    }
+    w->round_throughput = throughput;
+    w->round_start = now;
+    w->round_latency = 0;
+    w->round_requests = 0;
+}
+
+/*
+ * Hill-climb on throughput, one window of requests at a time: keep doubling
+ * the batch while puzzles per second improve, back off when they drop, and
+ * halve whenever the average request takes longer than MAX_BATCH_LATENCY.
+ */
+void adapt_batch(worker_args *w, int count, double latency) {
+    if (w->adapt_start == 0) {
+        w->adapt_start = now_ms() - latency;
+    }
+    w->adapt_puzzles += count;
+    w->adapt_latency += latency;
+    if (++w->adapt_requests < w->window) {
+        return;
+    }
+
+    double throughput = w->adapt_puzzles / (now_ms() - w->adapt_start);
+    if (w->adapt_latency / w->adapt_requests > MAX_BATCH_LATENCY || throughput < w->last_throughput) {
+        w->batch_size = w->batch_size / 2 > 1 ? w->batch_size / 2 : 1;
+    } else {
+        w->batch_size = w->batch_size * 2 < max_batch ? w->batch_size * 2 : max_batch;
+    }
+    w->last_throughput = throughput;
+    w->adapt_start = now_ms();
+    w->adapt_latency = 0;
+    w->adapt_puzzles = 0;
+    w->adapt_requests = 0;
+}
+
+size_t batch_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    request_slot *slot = userdata;
+    size_t length = size * nmemb;
+    size_t room = 2 * max_batch + 63 - slot->response_length;
+    size_t kept = length < room ? length : room;
+    memcpy(slot->response + slot->response_length, ptr, kept);
+    slot->response_length += kept;
+    return length;
+}
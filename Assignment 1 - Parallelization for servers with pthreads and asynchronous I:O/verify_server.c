@@ -0,0 +1,748 @@
+/*
+ * A stand-in for the /verify server, so the verifiers can be benchmarked
+ * offline.  Every POST body is either one {"content":[[...],...]} grid,
+ * answered with 1 or 0, or a JSON array of such grids (batch mode), answered
+ * with an array of verdicts in the same order.
+ *
+ * One thread serves every connection from an epoll loop.  Each response can
+ * be held back by a fixed latency (-d ms) plus uniform jitter (-j ms), and a
+ * fraction of requests (-e rate) fail with a 500, so client throughput and
+ * tail latency can be measured against controlled server behaviour.
+ *
+ * A connection that opens with the HTTP/2 preface, or upgrades to h2c from
+ * its first request, is served as HTTP/2, just enough for the verifiers'
+ * multiplexed mode: request headers are skipped rather than decoded (every
+ * stream is a POST to /verify), responses use static HPACK entries only, and
+ * the client never runs out of flow control window because the server
+ * advertises a large one and hands it back as data arrives.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "common.h"
+#include "validator.h"
+
+#define DEFAULT_PORT 4590
+#define MAX_EVENTS 256
+#define INITIAL_BUFFER 4096
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LENGTH 24
+#define H2_FRAME_HEADER 9
+#define H2_MAX_FRAME 16384          /* default SETTINGS_MAX_FRAME_SIZE */
+#define H2_MAX_STREAMS 4096
+#define H2_WINDOW 0x1000000           /* 16 MB; libcurl 7.88 stalls near 2^31 - 1 */
+
+#define H2_DATA 0x0
+#define H2_HEADERS 0x1
+#define H2_RST_STREAM 0x3
+#define H2_SETTINGS 0x4
+#define H2_PING 0x6
+#define H2_WINDOW_UPDATE 0x8
+
+/* Connection protocol: HTTP/1.1, switched by Upgrade: h2c but still waiting
+ * for the client preface, or HTTP/2 */
+#define H2_OFF 0
+#define H2_UPGRADED 1
+#define H2_ON 2
+
+#define H2_END_STREAM 0x1
+#define H2_ACK 0x1
+#define H2_END_HEADERS 0x4
+#define H2_PADDED 0x8
+
+/* The request body of an open HTTP/2 stream */
+typedef struct {
+    unsigned id;
+    char *body;
+    size_t length;
+    size_t capacity;
+} h2_stream;
+
+typedef struct {
+    int open;
+    unsigned generation;        /* bumped on close, invalidates stale timers */
+    char *in;
+    size_t in_length;
+    size_t in_capacity;
+    char *out;
+    size_t out_length;
+    size_t out_sent;
+    size_t out_capacity;
+    int responding;             /* a response is queued or being written */
+    int h2;                     /* H2_OFF, H2_UPGRADED or H2_ON */
+    h2_stream *streams;
+    int num_streams;
+    int stream_capacity;
+} connection;
+
+/* A response waiting for its injected delay to pass.  HTTP/1.1 responses
+ * wait in the connection's output buffer; HTTP/2 ones carry their frames */
+typedef struct {
+    double due;
+    int fd;
+    unsigned generation;
+    char *frames;
+    size_t length;
+} timer;
+
+connection *connections;
+int max_connections;
+
+timer *timers;
+int num_timers = 0;
+int timer_capacity = 0;
+
+int epoll_fd;
+double delay = 0;
+double jitter = 0;
+double error_rate = 0;
+uint64_t rng = 459;
+
+double now_ms();
+
+double next_uniform();
+
+void accept_connections(int listen_fd);
+
+void close_connection(int fd);
+
+/* Read what is available and handle a complete request if there is one */
+void handle_readable(int fd);
+
+/* Parse the next buffered request and queue its response */
+void handle_request(int fd);
+
+/* Write as much of the queued response as the socket takes */
+void flush_connection(int fd);
+
+/* Append length bytes to the connection's output buffer */
+void queue_output(connection *conn, const char *data, size_t length);
+
+void push_timer(double due, int fd, unsigned generation, char *frames, size_t length);
+
+timer pop_timer();
+
+/* Verify every grid in the NUL terminated body of content_length bytes and
+ * write the response body into reply, which needs room for
+ * 2 * (content_length / 162 + 1) + 2 bytes; returns the reply length and
+ * sets the HTTP status */
+int answer(char *body, size_t content_length, char *reply, int *status);
+
+/* Verify every grid in body; returns the number of verdicts written */
+int verify_body(char *body, int *verdicts, int max_verdicts);
+
+/* Queue the server preface: SETTINGS and the connection window */
+void start_h2(connection *conn);
+
+/* Handle every complete frame buffered on an HTTP/2 connection */
+void handle_frames(int fd);
+
+/* Answer stream id, whose NUL terminated request body is complete */
+void respond_h2(int fd, unsigned id, char *body, size_t length);
+
+/* Answer a stream whose request body is complete, then forget it */
+void finish_stream(int fd, h2_stream *stream);
+
+/* Write a frame header for a payload of length bytes into frame */
+void write_frame_header(char *frame, size_t length, int type, int flags, unsigned stream_id);
+
+int main(int argc, char **argv) {
+    /* Parse arguments */
+    int c;
+    int port = DEFAULT_PORT;
+    while ((c = getopt(argc, argv, "p:d:j:e:s:")) != -1) {
+        switch (c) {
+            case 'p':
+                port = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                delay = strtod(optarg, NULL);
+                break;
+            case 'j':
+                jitter = strtod(optarg, NULL);
+                break;
+            case 'e':
+                error_rate = strtod(optarg, NULL);
+                break;
+            case 's':
+                rng = strtoull(optarg, NULL, 10) | 1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    max_connections = sysconf(_SC_OPEN_MAX);
+    if (max_connections <= 0 || max_connections > 1 << 20) {
+        max_connections = 1 << 20;
+    }
+    connections = calloc(max_connections, sizeof(connection));
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listen_fd, (struct sockaddr *) &address, sizeof(address)) < 0
+        || listen(listen_fd, SOMAXCONN) < 0) {
+        perror("listen ");
+        return EXIT_FAILURE;
+    }
+
+    epoll_fd = epoll_create1(0);
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = listen_fd };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+
+    printf("Listening on port %d (delay %.1f ms, jitter %.1f ms, error rate %.3f).\n",
+           port, delay, jitter, error_rate);
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        /* Sleep until the next socket event or the next delayed response */
+        int timeout = -1;
+        if (num_timers > 0) {
+            double wait = timers[0].due - now_ms();
+            timeout = wait > 0 ? (int) wait + 1 : 0;
+        }
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                accept_connections(listen_fd);
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                close_connection(fd);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flush_connection(fd);
+            }
+            if (connections[fd].open && (events[i].events & EPOLLIN)) {
+                handle_readable(fd);
+            }
+        }
+
+        double now = now_ms();
+        while (num_timers > 0 && timers[0].due <= now) {
+            timer t = pop_timer();
+            if (connections[t.fd].open && connections[t.fd].generation == t.generation) {
+                if (t.frames != NULL) {
+                    queue_output(&connections[t.fd], t.frames, t.length);
+                }
+                flush_connection(t.fd);
+            }
+            free(t.frames);
+        }
+    }
+}
+
+void accept_connections(int listen_fd) {
+    int one = 1;
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        if (fd >= max_connections) {
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        connection *conn = &connections[fd];
+        conn->open = 1;
+        conn->in_length = 0;
+        conn->out_length = 0;
+        conn->out_sent = 0;
+        conn->responding = 0;
+        conn->h2 = H2_OFF;
+        if (conn->in == NULL) {
+            conn->in_capacity = INITIAL_BUFFER;
+            conn->in = malloc(conn->in_capacity);
+            conn->out_capacity = INITIAL_BUFFER;
+            conn->out = malloc(conn->out_capacity);
+        }
+
+        struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void close_connection(int fd) {
+    if (!connections[fd].open) return;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    for (int i = 0; i < connections[fd].num_streams; i++) {
+        free(connections[fd].streams[i].body);
+    }
+    connections[fd].num_streams = 0;
+    connections[fd].open = 0;
+    connections[fd].generation++;
+}
+
+void handle_readable(int fd) {
+    connection *conn = &connections[fd];
+    while (1) {
+        if (conn->in_length + 1 >= conn->in_capacity) {
+            conn->in_capacity *= 2;
+            conn->in = realloc(conn->in, conn->in_capacity);
+        }
+        ssize_t received = read(fd, conn->in + conn->in_length, conn->in_capacity - conn->in_length - 1);
+        if (received > 0) {
+            conn->in_length += received;
+            continue;
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close_connection(fd);
+            return;
+        }
+        break;
+    }
+
+    /* The client preface opens HTTP/2, either with prior knowledge or
+     * right after an upgrade, when the server preface is already out */
+    if (conn->h2 != H2_ON && conn->in_length >= H2_PREFACE_LENGTH
+        && memcmp(conn->in, H2_PREFACE, H2_PREFACE_LENGTH) == 0) {
+        if (conn->h2 == H2_OFF) {
+            start_h2(conn);
+        }
+        conn->h2 = H2_ON;
+        memmove(conn->in, conn->in + H2_PREFACE_LENGTH, conn->in_length - H2_PREFACE_LENGTH);
+        conn->in_length -= H2_PREFACE_LENGTH;
+    } else if (conn->h2 != H2_ON && conn->in_length < H2_PREFACE_LENGTH
+               && memcmp(conn->in, H2_PREFACE, conn->in_length) == 0) {
+        /* Part of the preface; it would parse as an HTTP/1.1 request */
+        return;
+    }
+    if (conn->h2 == H2_ON) {
+        handle_frames(fd);
+    } else if (conn->h2 == H2_OFF && !conn->responding) {
+        handle_request(fd);
+    }
+}
+
+void handle_request(int fd) {
+    connection *conn = &connections[fd];
+
+    conn->in[conn->in_length] = '\0';
+    char *header_end = strstr(conn->in, "\r\n\r\n");
+    if (header_end == NULL) return;
+    size_t header_length = header_end + 4 - conn->in;
+
+    size_t content_length = 0;
+    char *field = strcasestr(conn->in, "\r\ncontent-length:");
+    if (field != NULL && field < header_end) {
+        content_length = strtoul(field + strlen("\r\ncontent-length:"), NULL, 10);
+    }
+    size_t request_length = header_length + content_length;
+    if (conn->in_length < request_length) {
+        if (request_length + 1 > conn->in_capacity) {
+            conn->in_capacity = request_length + 1;
+            conn->in = realloc(conn->in, conn->in_capacity);
+        }
+        return;
+    }
+
+    /* The body is NUL terminated for parsing; keep the byte it replaces */
+    char saved = conn->in[request_length];
+    conn->in[request_length] = '\0';
+
+    /* Upgrade: h2c turns the connection to HTTP/2, with this request as
+     * stream 1; the response goes out as HTTP/2 frames after the 101 */
+    char *upgrade = strcasestr(conn->in, "\r\nupgrade: h2c");
+    if (upgrade != NULL && upgrade < header_end) {
+        const char *switching = "HTTP/1.1 101 Switching Protocols\r\n"
+                                "Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+        queue_output(conn, switching, strlen(switching));
+        start_h2(conn);
+        conn->h2 = H2_UPGRADED;
+        respond_h2(fd, 1, conn->in + header_length, content_length);
+        conn->in[request_length] = saved;
+        memmove(conn->in, conn->in + request_length, conn->in_length - request_length);
+        conn->in_length -= request_length;
+        flush_connection(fd);
+        return;
+    }
+
+    char *reply = malloc(2 * (content_length / 162 + 1) + 2);
+    int status;
+    int body_length = answer(conn->in + header_length, content_length, reply, &status);
+    conn->in[request_length] = saved;
+
+    /* Build the whole response now; it is only sent once its delay is up */
+    size_t needed = 128 + body_length;
+    if (needed > conn->out_capacity) {
+        conn->out_capacity = needed;
+        conn->out = realloc(conn->out, needed);
+    }
+    const char *reason = status == 200 ? "OK" : status == 400 ? "Bad Request" : "Internal Server Error";
+    int length = sprintf(conn->out, "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                                    "Content-Length: %d\r\n\r\n", status, reason, body_length);
+    memcpy(conn->out + length, reply, body_length);
+    free(reply);
+    conn->out_length = length + body_length;
+    conn->out_sent = 0;
+    conn->responding = 1;
+
+    /* Keep whatever the client already pipelined behind this request */
+    memmove(conn->in, conn->in + request_length, conn->in_length - request_length);
+    conn->in_length -= request_length;
+
+    double hold = delay + jitter * next_uniform();
+    if (hold > 0) {
+        push_timer(now_ms() + hold, fd, conn->generation, NULL, 0);
+    } else {
+        flush_connection(fd);
+    }
+}
+
+void flush_connection(int fd) {
+    connection *conn = &connections[fd];
+    while (conn->out_sent < conn->out_length) {
+        ssize_t written = write(fd, conn->out + conn->out_sent, conn->out_length - conn->out_sent);
+        if (written > 0) {
+            conn->out_sent += written;
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct epoll_event event = { .events = EPOLLIN | EPOLLOUT, .data.fd = fd };
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+            return;
+        }
+        close_connection(fd);
+        return;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    conn->out_length = 0;
+    conn->out_sent = 0;
+    if (conn->h2 != H2_OFF) {
+        return;
+    }
+    conn->responding = 0;
+
+    /* A pipelined request may already be waiting */
+    handle_request(fd);
+}
+
+void queue_output(connection *conn, const char *data, size_t length) {
+    if (conn->out_sent > 0) {
+        memmove(conn->out, conn->out + conn->out_sent, conn->out_length - conn->out_sent);
+        conn->out_length -= conn->out_sent;
+        conn->out_sent = 0;
+    }
+    if (conn->out_length + length > conn->out_capacity) {
+        while (conn->out_length + length > conn->out_capacity) {
+            conn->out_capacity *= 2;
+        }
+        conn->out = realloc(conn->out, conn->out_capacity);
+    }
+    memcpy(conn->out + conn->out_length, data, length);
+    conn->out_length += length;
+}
+
+void start_h2(connection *conn) {
+    /* SETTINGS: many streams, and a large window for each of them */
+    char frames[H2_FRAME_HEADER + 12 + H2_FRAME_HEADER + 4];
+    char *settings = frames + H2_FRAME_HEADER;
+    write_frame_header(frames, 12, H2_SETTINGS, 0, 0);
+    settings[0] = 0;
+    settings[1] = 0x3;
+    settings[2] = H2_MAX_STREAMS >> 24;
+    settings[3] = H2_MAX_STREAMS >> 16;
+    settings[4] = H2_MAX_STREAMS >> 8;
+    settings[5] = H2_MAX_STREAMS & 0xFF;
+    settings[6] = 0;
+    settings[7] = 0x4;
+    settings[8] = H2_WINDOW >> 24;
+    settings[9] = H2_WINDOW >> 16 & 0xFF;
+    settings[10] = H2_WINDOW >> 8 & 0xFF;
+    settings[11] = H2_WINDOW & 0xFF;
+
+    /* The connection window starts at 65535 and can only grow by update */
+    unsigned increment = H2_WINDOW - 65535;
+    char *update = frames + H2_FRAME_HEADER + 12;
+    write_frame_header(update, 4, H2_WINDOW_UPDATE, 0, 0);
+    update[H2_FRAME_HEADER] = increment >> 24;
+    update[H2_FRAME_HEADER + 1] = increment >> 16 & 0xFF;
+    update[H2_FRAME_HEADER + 2] = increment >> 8 & 0xFF;
+    update[H2_FRAME_HEADER + 3] = increment & 0xFF;
+    queue_output(conn, frames, sizeof(frames));
+}
+
+void handle_frames(int fd) {
+    connection *conn = &connections[fd];
+    unsigned char *in = (unsigned char *) conn->in;
+    size_t offset = 0;
+
+    while (conn->in_length - offset >= H2_FRAME_HEADER) {
+        unsigned char *frame = in + offset;
+        size_t length = frame[0] << 16 | frame[1] << 8 | frame[2];
+        int type = frame[3];
+        int flags = frame[4];
+        unsigned id = (frame[5] & 0x7F) << 24 | frame[6] << 16 | frame[7] << 8 | frame[8];
+        if (conn->in_length - offset < H2_FRAME_HEADER + length) {
+            break;
+        }
+        char *payload = (char *) frame + H2_FRAME_HEADER;
+        offset += H2_FRAME_HEADER + length;
+
+        h2_stream *stream = NULL;
+        for (int i = 0; i < conn->num_streams; i++) {
+            if (conn->streams[i].id == id) {
+                stream = &conn->streams[i];
+                break;
+            }
+        }
+
+        if (type == H2_HEADERS && stream == NULL) {
+            /* The header block is not decoded: every stream is a /verify POST */
+            if (conn->num_streams == conn->stream_capacity) {
+                conn->stream_capacity = conn->stream_capacity ? 2 * conn->stream_capacity : 16;
+                conn->streams = realloc(conn->streams, conn->stream_capacity * sizeof(h2_stream));
+            }
+            stream = &conn->streams[conn->num_streams++];
+            stream->id = id;
+            stream->capacity = INITIAL_BUFFER;
+            stream->body = malloc(stream->capacity);
+            stream->length = 0;
+            if (flags & H2_END_STREAM) {
+                finish_stream(fd, stream);
+            }
+        } else if (type == H2_DATA && stream != NULL) {
+            char *data = payload;
+            size_t data_length = length;
+            if (flags & H2_PADDED) {
+                data_length -= 1 + (unsigned char) payload[0];
+                data++;
+            }
+            if (stream->length + data_length + 1 > stream->capacity) {
+                while (stream->length + data_length + 1 > stream->capacity) {
+                    stream->capacity *= 2;
+                }
+                stream->body = realloc(stream->body, stream->capacity);
+            }
+            memcpy(stream->body + stream->length, data, data_length);
+            stream->length += data_length;
+
+            /* Give the connection window back as soon as data arrives */
+            if (length > 0) {
+                char update[H2_FRAME_HEADER + 4];
+                write_frame_header(update, 4, H2_WINDOW_UPDATE, 0, 0);
+                update[H2_FRAME_HEADER] = length >> 24;
+                update[H2_FRAME_HEADER + 1] = length >> 16 & 0xFF;
+                update[H2_FRAME_HEADER + 2] = length >> 8 & 0xFF;
+                update[H2_FRAME_HEADER + 3] = length & 0xFF;
+                queue_output(conn, update, sizeof(update));
+            }
+            if (flags & H2_END_STREAM) {
+                finish_stream(fd, stream);
+            }
+        } else if (type == H2_RST_STREAM && stream != NULL) {
+            free(stream->body);
+            *stream = conn->streams[--conn->num_streams];
+        } else if (type == H2_SETTINGS && !(flags & H2_ACK)) {
+            char ack[H2_FRAME_HEADER];
+            write_frame_header(ack, 0, H2_SETTINGS, H2_ACK, 0);
+            queue_output(conn, ack, sizeof(ack));
+        } else if (type == H2_PING && !(flags & H2_ACK) && length == 8) {
+            char pong[H2_FRAME_HEADER + 8];
+            write_frame_header(pong, 8, H2_PING, H2_ACK, 0);
+            memcpy(pong + H2_FRAME_HEADER, payload, 8);
+            queue_output(conn, pong, sizeof(pong));
+        }
+        /* Anything else (PRIORITY, WINDOW_UPDATE, GOAWAY, CONTINUATION of
+         * headers we skip anyway) needs no answer */
+    }
+
+    memmove(conn->in, conn->in + offset, conn->in_length - offset);
+    conn->in_length -= offset;
+    if (conn->out_length > conn->out_sent) {
+        flush_connection(fd);
+    }
+}
+
+void finish_stream(int fd, h2_stream *stream) {
+    connection *conn = &connections[fd];
+    stream->body[stream->length] = '\0';
+    respond_h2(fd, stream->id, stream->body, stream->length);
+    free(stream->body);
+    *stream = conn->streams[--conn->num_streams];
+}
+
+void respond_h2(int fd, unsigned id, char *body, size_t content_length) {
+    connection *conn = &connections[fd];
+    char *reply = malloc(2 * (content_length / 162 + 1) + 2);
+    int status;
+    int body_length = answer(body, content_length, reply, &status);
+
+    /* HEADERS from the static table: :status 200/400/500 is indexed, and
+     * content-type (31) and content-length (28) are literals with indexed
+     * names, never added to the dynamic table */
+    char block[64];
+    int block_length = 0;
+    block[block_length++] = status == 200 ? 0x88 : status == 400 ? 0x8C : 0x8E;
+    block[block_length++] = 0x0F;
+    block[block_length++] = 31 - 15;
+    block[block_length++] = strlen("application/json");
+    memcpy(block + block_length, "application/json", strlen("application/json"));
+    block_length += strlen("application/json");
+    block[block_length++] = 0x0F;
+    block[block_length++] = 28 - 15;
+    int digits = sprintf(block + block_length + 1, "%d", body_length);
+    block[block_length] = digits;
+    block_length += 1 + digits;
+
+    /* Then the body, in DATA frames no larger than the client accepts */
+    int num_data = (body_length + H2_MAX_FRAME - 1) / H2_MAX_FRAME;
+    size_t length = H2_FRAME_HEADER + block_length + num_data * H2_FRAME_HEADER + body_length;
+    char *frames = malloc(length);
+    write_frame_header(frames, block_length, H2_HEADERS,
+                       H2_END_HEADERS | (body_length == 0 ? H2_END_STREAM : 0), id);
+    memcpy(frames + H2_FRAME_HEADER, block, block_length);
+    char *cursor = frames + H2_FRAME_HEADER + block_length;
+    for (int sent = 0; sent < body_length; sent += H2_MAX_FRAME) {
+        int chunk = body_length - sent < H2_MAX_FRAME ? body_length - sent : H2_MAX_FRAME;
+        write_frame_header(cursor, chunk, H2_DATA,
+                           sent + chunk == body_length ? H2_END_STREAM : 0, id);
+        memcpy(cursor + H2_FRAME_HEADER, reply + sent, chunk);
+        cursor += H2_FRAME_HEADER + chunk;
+    }
+    free(reply);
+
+    double hold = delay + jitter * next_uniform();
+    if (hold > 0) {
+        push_timer(now_ms() + hold, fd, conn->generation, frames, length);
+    } else {
+        queue_output(conn, frames, length);
+        free(frames);
+    }
+}
+
+void write_frame_header(char *frame, size_t length, int type, int flags, unsigned stream_id) {
+    frame[0] = length >> 16 & 0xFF;
+    frame[1] = length >> 8 & 0xFF;
+    frame[2] = length & 0xFF;
+    frame[3] = type;
+    frame[4] = flags;
+    frame[5] = stream_id >> 24 & 0x7F;
+    frame[6] = stream_id >> 16 & 0xFF;
+    frame[7] = stream_id >> 8 & 0xFF;
+    frame[8] = stream_id & 0xFF;
+}
+
+/* Binary min-heap on due time */
+void push_timer(double due, int fd, unsigned generation, char *frames, size_t length) {
+    if (num_timers == timer_capacity) {
+        timer_capacity = timer_capacity ? 2 * timer_capacity : 64;
+        timers = realloc(timers, timer_capacity * sizeof(timer));
+    }
+    int i = num_timers++;
+    while (i > 0 && timers[(i - 1) / 2].due > due) {
+        timers[i] = timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timers[i].due = due;
+    timers[i].fd = fd;
+    timers[i].generation = generation;
+    timers[i].frames = frames;
+    timers[i].length = length;
+}
+
+timer pop_timer() {
+    timer top = timers[0];
+    timer last = timers[--num_timers];
+    int i = 0;
+    while (2 * i + 1 < num_timers) {
+        int child = 2 * i + 1;
+        if (child + 1 < num_timers && timers[child + 1].due < timers[child].due) child++;
+        if (timers[child].due >= last.due) break;
+        timers[i] = timers[child];
+        i = child;
+    }
+    timers[i] = last;
+    return top;
+}
+
+int answer(char *body, size_t content_length, char *reply, int *status) {
+    int max_verdicts = content_length / 162 + 1;
+    int *verdicts = malloc(max_verdicts * sizeof(int));
+    int count = verify_body(body, verdicts, max_verdicts);
+    while (*body == ' ' || *body == '\r' || *body == '\n' || *body == '\t') body++;
+
+    *status = 200;
+    if (count == 0) {
+        *status = 400;
+    } else if (error_rate > 0 && next_uniform() < error_rate) {
+        *status = 500;
+        count = 0;
+    }
+
+    int length = 0;
+    if (count > 0 && *body == '[') {
+        reply[length++] = '[';
+        for (int i = 0; i < count; i++) {
+            if (i > 0) reply[length++] = ',';
+            reply[length++] = '0' + verdicts[i];
+        }
+        reply[length++] = ']';
+    } else if (count > 0) {
+        reply[length++] = '0' + verdicts[0];
+    }
+    free(verdicts);
+    return length;
+}
+
+int verify_body(char *body, int *verdicts, int max_verdicts) {
+    int count = 0;
+    char *cursor = body;
+    while (count < max_verdicts && (cursor = strstr(cursor, "\"content\"")) != NULL) {
+        puzzle p;
+        int cells = 0;
+        cursor += strlen("\"content\"");
+        while (cells < 81 && *cursor != '\0' && *cursor != '}') {
+            if (*cursor >= '0' && *cursor <= '9') {
+                p.content[cells / 9][cells % 9] = strtol(cursor, &cursor, 10);
+                cells++;
+            } else {
+                cursor++;
+            }
+        }
+        verdicts[count++] = cells == 81 && validate_grid(&p);
+    }
+    return count;
+}
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* xorshift64* mapped to [0, 1) */
+double next_uniform() {
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
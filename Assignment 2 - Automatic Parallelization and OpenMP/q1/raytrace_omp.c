@@ -0,0 +1,1265 @@
+/* A simple ray tracer, rendered in parallel tiles with OpenMP */
+/* Based on raytrace_simple.c; source: http://www.purplealienplanet.com/node/23 */
+/* Author writes: "The code is licensed under BSD, so use it however you want". */
+
+#include <stdio.h>
+#include <stdbool.h> /* Needed for boolean datatype */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <immintrin.h>
+#include <omp.h>
+#include "scene.h"
+
+#define min(a,b) (((a) < (b)) ? (a) : (b))
+
+/* Width and height of out image */
+#define WIDTH  800
+#define HEIGHT 60000
+
+/* Tiles are the unit of work handed to the threads.  A few sphere-covered
+ * tiles cost more than thousands of empty ones, so they are handed out one
+ * at a time as threads become free rather than split up front */
+#define TILE_WIDTH  64
+#define TILE_HEIGHT 16
+
+/* The ray */
+typedef struct{
+        vector start;
+        vector dir;
+}ray;
+
+/* Subtract two vectors and return the resulting vector */
+vector vectorSub(vector *v1, vector *v2){
+	vector result = {v1->x - v2->x, v1->y - v2->y, v1->z - v2->z };
+	return result;
+}
+
+/* Multiply two vectors and return the resulting scalar (dot product) */
+float vectorDot(vector *v1, vector *v2){
+	return v1->x * v2->x + v1->y * v2->y + v1->z * v2->z;
+}
+
+/* Calculate Vector x Scalar and return resulting Vector*/ 
+vector vectorScale(float c, vector *v){
+        vector result = {v->x * c, v->y * c, v->z * c };
+        return result;
+}
+
+/* Add two vectors and return the resulting vector */
+vector vectorAdd(vector *v1, vector *v2){
+        vector result = {v1->x + v2->x, v1->y + v2->y, v1->z + v2->z };
+        return result;
+}
+
+/* The spheres, one array per field.  The arrays are padded to a multiple of
+ * 8 and aligned, so that 8 spheres load as one vector */
+int numSpheres = 0;
+float *sphereX, *sphereY, *sphereZ;
+float *sphereRadius;
+float *sphereR2;	/* radius squared */
+int *sphereMaterial;
+
+/* Check if the ray and the s'th sphere intersect */
+bool intersectRaySphere(ray *r, int s, float *t){
+	
+	bool retval = false;
+
+	/* A = d.d, the vector dot product of the direction */
+	float A = vectorDot(&r->dir, &r->dir); 
+	
+	/* We need a vector representing the distance between the start of 
+	 * the ray and the position of the circle.
+	 * This is the term (p0 - c) 
+	 */
+	vector pos = {sphereX[s], sphereY[s], sphereZ[s]};
+	vector dist = vectorSub(&r->start, &pos);
+	
+	/* 2d.(p0 - c) */  
+	float B = 2 * vectorDot(&r->dir, &dist);
+	
+	/* (p0 - c).(p0 - c) - r^2 */
+	float C = vectorDot(&dist, &dist) - sphereR2[s];
+	
+	/* Solving the discriminant */
+	float discr = B * B - 4 * A * C;
+	
+	/* If the discriminant is negative, there are no real roots.
+	 * Return false in that case as the ray misses the sphere.
+	 * Return true in all other cases (can be one or two intersections)
+	 * t represents the distance between the start of the ray and
+	 * the point on the sphere where it intersects.
+	 */
+	if(discr < 0)
+		retval = false;
+	else{
+		float sqrtdiscr = sqrtf(discr);
+		float t0 = (-B + sqrtdiscr)/(2);
+		float t1 = (-B - sqrtdiscr)/(2);
+		
+		/* We want the closest one */
+		if(t0 > t1)
+			t0 = t1;
+
+		/* Verify t1 larger than 0 and less than the original t */
+		if((t0 > 0.001f) && (t0 < *t)){
+			*t = t0;
+			retval = true;
+		}else
+			retval = false;
+	}
+
+return retval;
+}
+
+/* Find the closest sphere hit by r nearer than *t, one sphere at a time;
+ * returns its index, or -1 if there is none */
+int closestSphere(ray *r, float *t){
+	int currentSphere = -1;
+	int i;
+	for(i = 0; i < numSpheres; i++){
+		if(intersectRaySphere(r, i, t))
+			currentSphere = i;
+	}
+	return currentSphere;
+}
+
+/* 8-wide dot product, summed in the same order as vectorDot */
+__attribute__((target("avx2")))
+static inline __m256 dot8(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz){
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+
+/* closestSphere testing 8 spheres per instruction.  Each lane keeps the
+ * nearest hit among its spheres; the lanes are then reduced to the nearest
+ * overall, the lower index winning a tie just as in the scalar loop */
+__attribute__((target("avx2")))
+int closestSphereAvx2(ray *r, float *t){
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 sx = _mm256_set1_ps(r->start.x), sy = _mm256_set1_ps(r->start.y), sz = _mm256_set1_ps(r->start.z);
+	__m256 dx = _mm256_set1_ps(r->dir.x), dy = _mm256_set1_ps(r->dir.y), dz = _mm256_set1_ps(r->dir.z);
+	__m256 fourA = _mm256_set1_ps(4 * vectorDot(&r->dir, &r->dir));
+	__m256 best = _mm256_set1_ps(*t);
+	__m256i bestIndex = _mm256_set1_epi32(-1);
+	__m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	int i;
+	
+	for(i = 0; i < numSpheres; i += 8){
+		__m256 valid = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(numSpheres), index));
+		__m256 distx = _mm256_sub_ps(sx, _mm256_load_ps(&sphereX[i]));
+		__m256 disty = _mm256_sub_ps(sy, _mm256_load_ps(&sphereY[i]));
+		__m256 distz = _mm256_sub_ps(sz, _mm256_load_ps(&sphereZ[i]));
+		__m256 B = _mm256_mul_ps(two, dot8(dx, dy, dz, distx, disty, distz));
+		__m256 C = _mm256_sub_ps(dot8(distx, disty, distz, distx, disty, distz), _mm256_load_ps(&sphereR2[i]));
+		__m256 discr = _mm256_sub_ps(_mm256_mul_ps(B, B), _mm256_mul_ps(fourA, C));
+		
+		/* A negative discriminant gives a NaN root, which fails the
+		 * range test below just as the scalar early return does */
+		__m256 sqrtdiscr = _mm256_sqrt_ps(discr);
+		__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(sqrtdiscr, B), half);
+		__m256 t1 = _mm256_mul_ps(_mm256_xor_ps(_mm256_add_ps(B, sqrtdiscr), sign), half);
+		t0 = _mm256_blendv_ps(t0, t1, _mm256_cmp_ps(t0, t1, _CMP_GT_OQ));
+		
+		__m256 hit = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t0, _mm256_set1_ps(0.001f), _CMP_GT_OQ),
+		                                                _mm256_cmp_ps(t0, best, _CMP_LT_OQ)));
+		best = _mm256_blendv_ps(best, t0, hit);
+		bestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(index), hit));
+		index = _mm256_add_epi32(index, _mm256_set1_epi32(8));
+	}
+	
+	/* Nearest t in every lane, then the lowest index among the lanes holding it */
+	__m256 m = _mm256_min_ps(best, _mm256_permute2f128_ps(best, best, 1));
+	m = _mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(1, 0, 3, 2)));
+	m = _mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(2, 3, 0, 1)));
+	__m256 nearest = _mm256_and_ps(_mm256_cmp_ps(best, m, _CMP_EQ_OQ),
+	                               _mm256_castsi256_ps(_mm256_cmpgt_epi32(bestIndex, _mm256_set1_epi32(-1))));
+	__m256i candidates = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF)),
+	                                                          _mm256_castsi256_ps(bestIndex), nearest));
+	candidates = _mm256_min_epi32(candidates, _mm256_permute2x128_si256(candidates, candidates, 1));
+	candidates = _mm256_min_epi32(candidates, _mm256_shuffle_epi32(candidates, _MM_SHUFFLE(1, 0, 3, 2)));
+	candidates = _mm256_min_epi32(candidates, _mm256_shuffle_epi32(candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+	int currentSphere = _mm256_cvtsi256_si32(candidates);
+	if(currentSphere == 0x7FFFFFFF)
+		return -1;
+	*t = _mm256_cvtss_f32(m);
+	return currentSphere;
+}
+
+/* Bounding volume hierarchy over the spheres.  The nodes are kept in one
+ * array, with the two children of an inner node side by side, so a node
+ * and its sibling share a cache line */
+typedef struct{
+	float min[3], max[3];
+	int offset;	/* inner node: index of the first child; leaf: first entry in bvhSpheres */
+	int count;	/* spheres in a leaf, 0 for an inner node */
+}bvhNode;
+
+#define BVH_MIN_SPHERES 32	/* smaller scenes are searched linearly */
+#define BVH_BINS 16
+#define BVH_LEAF 4		/* nodes this small always become leaves */
+#define BVH_MAX_LEAF 16		/* and nodes larger than this never do */
+#define BVH_TASK 4096		/* larger subtrees are built as separate tasks */
+#define BVH_STACK 64
+#define BVH_MEDIAN_DEPTH 40	/* deeper than this, split in the middle so the stack cannot overflow */
+
+bvhNode *bvhNodes = NULL;
+int bvhNodeCount;
+int *bvhSpheres;	/* sphere indices in leaf order */
+
+float boxArea(float *min, float *max){
+	float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	return 2 * (dx * dy + dy * dz + dz * dx);
+}
+
+void growBox(float *min, float *max, float *otherMin, float *otherMax){
+	int k;
+	for(k = 0; k < 3; k++){
+		min[k] = fminf(min[k], otherMin[k]);
+		max[k] = fmaxf(max[k], otherMax[k]);
+	}
+}
+
+/* Bounds of sphere s, padded so that a ray the quadratic counts as a
+ * grazing hit despite rounding still enters the box */
+void sphereBox(int s, float *min, float *max){
+	float r = sphereRadius[s] * 1.001f + 0.01f;
+	min[0] = sphereX[s] - r; max[0] = sphereX[s] + r;
+	min[1] = sphereY[s] - r; max[1] = sphereY[s] + r;
+	min[2] = sphereZ[s] - r; max[2] = sphereZ[s] + r;
+}
+
+float sphereCentre(int s, int axis){
+	return axis == 0 ? sphereX[s] : axis == 1 ? sphereY[s] : sphereZ[s];
+}
+
+/* Build the subtree for bvhSpheres[begin, end) into node.  Splits are
+ * chosen by the surface area heuristic, evaluated at BVH_BINS bins of the
+ * centres along each axis */
+void buildBvhNode(int node, int begin, int end, int depth){
+	bvhNode *n = &bvhNodes[node];
+	float centreMin[3] = {INFINITY, INFINITY, INFINITY}, centreMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+	float min[3], max[3];
+	int count = end - begin;
+	int i, k;
+	
+	for(k = 0; k < 3; k++){
+		n->min[k] = INFINITY;
+		n->max[k] = -INFINITY;
+	}
+	for(i = begin; i < end; i++){
+		int s = bvhSpheres[i];
+		sphereBox(s, min, max);
+		growBox(n->min, n->max, min, max);
+		for(k = 0; k < 3; k++){
+			centreMin[k] = fminf(centreMin[k], sphereCentre(s, k));
+			centreMax[k] = fmaxf(centreMax[k], sphereCentre(s, k));
+		}
+	}
+	n->offset = begin;
+	n->count = count;
+	if(count <= BVH_LEAF)
+		return;
+	
+	/* Cost of every split, in units of a sphere test: spheres times the
+	 * area of the box that holds them, relative to the parent */
+	float bestCost = INFINITY;
+	int bestAxis = -1, bestSplit = 0;
+	for(k = 0; k < 3 && depth < BVH_MEDIAN_DEPTH; k++){
+		float extent = centreMax[k] - centreMin[k];
+		if(extent <= 0)
+			continue;
+		int binCount[BVH_BINS] = {0};
+		float binMin[BVH_BINS][3], binMax[BVH_BINS][3];
+		int b;
+		for(b = 0; b < BVH_BINS; b++){
+			binMin[b][0] = binMin[b][1] = binMin[b][2] = INFINITY;
+			binMax[b][0] = binMax[b][1] = binMax[b][2] = -INFINITY;
+		}
+		for(i = begin; i < end; i++){
+			int s = bvhSpheres[i];
+			b = min((int) ((sphereCentre(s, k) - centreMin[k]) / extent * BVH_BINS), BVH_BINS - 1);
+			sphereBox(s, min, max);
+			growBox(binMin[b], binMax[b], min, max);
+			binCount[b]++;
+		}
+		
+		/* Sweep from the right to get the cost of everything above each split */
+		float rightArea[BVH_BINS];
+		int rightCount[BVH_BINS];
+		float accMin[3] = {INFINITY, INFINITY, INFINITY}, accMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+		int acc = 0;
+		for(b = BVH_BINS - 1; b > 0; b--){
+			growBox(accMin, accMax, binMin[b], binMax[b]);
+			acc += binCount[b];
+			rightArea[b] = acc > 0 ? boxArea(accMin, accMax) : 0;
+			rightCount[b] = acc;
+		}
+		accMin[0] = accMin[1] = accMin[2] = INFINITY;
+		accMax[0] = accMax[1] = accMax[2] = -INFINITY;
+		acc = 0;
+		for(b = 0; b < BVH_BINS - 1; b++){
+			growBox(accMin, accMax, binMin[b], binMax[b]);
+			acc += binCount[b];
+			if(acc == 0 || rightCount[b + 1] == 0)
+				continue;
+			float cost = acc * boxArea(accMin, accMax) + rightCount[b + 1] * rightArea[b + 1];
+			if(cost < bestCost){
+				bestCost = cost;
+				bestAxis = k;
+				bestSplit = b;
+			}
+		}
+	}
+	
+	if(bestAxis >= 0 && bestCost >= count * boxArea(n->min, n->max) && count <= BVH_MAX_LEAF)
+		return;
+	
+	/* Partition in place; with no usable split, halve along the widest axis */
+	int mid;
+	if(bestAxis >= 0){
+		float extent = centreMax[bestAxis] - centreMin[bestAxis];
+		int j = end - 1;
+		i = begin;
+		while(i <= j){
+			int s = bvhSpheres[i];
+			int b = min((int) ((sphereCentre(s, bestAxis) - centreMin[bestAxis]) / extent * BVH_BINS), BVH_BINS - 1);
+			if(b <= bestSplit){
+				i++;
+			}else{
+				bvhSpheres[i] = bvhSpheres[j];
+				bvhSpheres[j--] = s;
+			}
+		}
+		mid = i;
+	}else{
+		mid = begin + count / 2;
+	}
+	
+	int child;
+	#pragma omp atomic capture
+	{ child = bvhNodeCount; bvhNodeCount += 2; }
+	n->offset = child;
+	n->count = 0;
+	
+	if(count > BVH_TASK){
+		#pragma omp task
+		buildBvhNode(child, begin, mid, depth + 1);
+		#pragma omp task
+		buildBvhNode(child + 1, mid, end, depth + 1);
+	}else{
+		buildBvhNode(child, begin, mid, depth + 1);
+		buildBvhNode(child + 1, mid, end, depth + 1);
+	}
+}
+
+void buildBvh(){
+	int i;
+	bvhNodes = malloc(2 * numSpheres * sizeof(bvhNode));
+	bvhSpheres = malloc(numSpheres * sizeof(int));
+	for(i = 0; i < numSpheres; i++)
+		bvhSpheres[i] = i;
+	bvhNodeCount = 1;
+	#pragma omp parallel
+	#pragma omp single
+	buildBvhNode(0, 0, numSpheres, 0);
+}
+
+/* Distance along r at which it enters the node's box, or INFINITY if it
+ * misses the box or enters it beyond t.  inv holds 1 / r->dir.  Plain
+ * compares rather than fminf/fmaxf, which are library calls without
+ * -ffast-math; a NaN slab (ray on the plane, zero direction) is ignored */
+static inline float enterBox(bvhNode *n, ray *r, vector *inv, float t){
+	float start[3] = {r->start.x, r->start.y, r->start.z};
+	float scale[3] = {inv->x, inv->y, inv->z};
+	float tmin = -INFINITY, tmax = INFINITY;
+	int axis;
+	for(axis = 0; axis < 3; axis++){
+		float t1 = (n->min[axis] - start[axis]) * scale[axis];
+		float t2 = (n->max[axis] - start[axis]) * scale[axis];
+		float near = t1 < t2 ? t1 : t2, far = t1 < t2 ? t2 : t1;
+		tmin = near > tmin ? near : tmin;
+		tmax = far < tmax ? far : tmax;
+	}
+	if(tmax < tmin || tmax < 0 || tmin > t)
+		return INFINITY;
+	return tmin;
+}
+
+/* closestSphere through the BVH, nearer child first.  Spheres are met out
+ * of index order, so an exact tie goes to the lower index explicitly to
+ * give the same answer as the linear search */
+int closestSphereBvh(ray *r, float *t){
+	vector inv = {1.0f / r->dir.x, 1.0f / r->dir.y, 1.0f / r->dir.z};
+	int stack[BVH_STACK];
+	float stackEntry[BVH_STACK];
+	int top = 0;
+	int currentSphere = -1;
+	int node = 0;
+	int i;
+	
+	if(enterBox(&bvhNodes[0], r, &inv, *t) == INFINITY)
+		return -1;
+	while(1){
+		bvhNode *n = &bvhNodes[node];
+		if(n->count > 0){
+			for(i = n->offset; i < n->offset + n->count; i++){
+				int s = bvhSpheres[i];
+				float t0 = nextafterf(*t, INFINITY);
+				if(intersectRaySphere(r, s, &t0) && (t0 < *t || s < currentSphere)){
+					*t = t0;
+					currentSphere = s;
+				}
+			}
+		}else{
+			int first = n->offset, second = n->offset + 1;
+			float near = enterBox(&bvhNodes[first], r, &inv, *t);
+			float far = enterBox(&bvhNodes[second], r, &inv, *t);
+			if(far < near){
+				int swap = first; first = second; second = swap;
+				float swapEntry = near; near = far; far = swapEntry;
+			}
+			if(near != INFINITY){
+				if(far != INFINITY){
+					stack[top] = second;
+					stackEntry[top++] = far;
+				}
+				node = first;
+				continue;
+			}
+		}
+		
+		/* Resume at the nearest postponed node still in reach */
+		do{
+			if(top == 0)
+				return currentSphere;
+			top--;
+		}while(stackEntry[top] > *t);
+		node = stack[top];
+	}
+}
+
+/* Start a PPM file of the given size; the pixels follow, top row first */
+FILE *openppm(char *filename, int width, int height){
+	/* FILE pointer */
+	FILE *f;
+
+	/* Open file for writing */
+	f = fopen(filename, "w");
+	if(f == NULL)
+		return NULL;
+
+	/* PPM header info, including the size of the image */
+	fprintf(f, "P6 %d %d %d\n", width, height, 255);
+	return f;
+}
+
+/* The rest of the scene, set up once and only read while rendering */
+material *materials;
+light *lights;
+int numLights;
+
+/* How rays are traced: one at a time (-s); one at a time against 8 spheres
+ * per instruction (-w); or, by default where the CPU has AVX2, in packets
+ * of 8 rays tested against one sphere at a time */
+#define TRACE_SCALAR  0
+#define TRACE_SPHERES 1
+#define TRACE_PACKETS 2
+int traceMode = TRACE_SCALAR;
+
+/* Trace each tile as one wavefront of rays, a bounce at a time (-v) */
+bool wavefrontMode = false;
+
+/* Rows in the image, HEIGHT unless -H asks for another */
+int imageHeight = HEIGHT;
+
+/* Render sc from now on; it must outlive the rendering */
+void useScene(scene *sc){
+	numSpheres = sc->numSpheres;
+	sphereX = sc->sphereX;
+	sphereY = sc->sphereY;
+	sphereZ = sc->sphereZ;
+	sphereRadius = sc->sphereRadius;
+	sphereR2 = sc->sphereR2;
+	sphereMaterial = sc->sphereMaterial;
+	materials = sc->materials;
+	lights = sc->lights;
+	numLights = sc->numLights;
+}
+
+/* The scene rendered when no file is given */
+void setupScene(scene *sc){
+	sphere spheres[3];
+	material materialList[3];
+	light lightList[3];
+	
+	materialList[0].diffuse.red = 1;
+	materialList[0].diffuse.green = 0;
+	materialList[0].diffuse.blue = 0;
+	materialList[0].reflection = 0.2;
+	
+	materialList[1].diffuse.red = 0;
+	materialList[1].diffuse.green = 1;
+	materialList[1].diffuse.blue = 0;
+	materialList[1].reflection = 0.5;
+	
+	materialList[2].diffuse.red = 0;
+	materialList[2].diffuse.green = 0;
+	materialList[2].diffuse.blue = 1;
+	materialList[2].reflection = 0.9;
+	
+	spheres[0].pos.x = 200;
+	spheres[0].pos.y = 300;
+	spheres[0].pos.z = 0;
+	spheres[0].radius = 100;
+	spheres[0].material = 0;
+	
+	spheres[1].pos.x = 400;
+	spheres[1].pos.y = 400;
+	spheres[1].pos.z = 0;
+	spheres[1].radius = 100;
+	spheres[1].material = 1;
+	
+	spheres[2].pos.x = 500;
+	spheres[2].pos.y = 140;
+	spheres[2].pos.z = 0;
+	spheres[2].radius = 100;
+	spheres[2].material = 2;
+	
+	lightList[0].pos.x = 0;
+	lightList[0].pos.y = 240;
+	lightList[0].pos.z = -100;
+	lightList[0].intensity.red = 1;
+	lightList[0].intensity.green = 1;
+	lightList[0].intensity.blue = 1;
+	
+	lightList[1].pos.x = 3200;
+	lightList[1].pos.y = 3000;
+	lightList[1].pos.z = -1000;
+	lightList[1].intensity.red = 0.6;
+	lightList[1].intensity.green = 0.7;
+	lightList[1].intensity.blue = 1;
+
+	lightList[2].pos.x = 600;
+	lightList[2].pos.y = 0;
+	lightList[2].pos.z = -100;
+	lightList[2].intensity.red = 0.3;
+	lightList[2].intensity.green = 0.5;
+	lightList[2].intensity.blue = 1;
+	
+	initScene(sc);
+	unsigned int i;
+	for(i = 0; i < 3; i++){
+		addSceneMaterial(sc, &materialList[i]);
+		addSceneLight(sc, &lightList[i]);
+		addSceneSphere(sc, &spheres[i]);
+	}
+}
+
+/* Numerical Recipes LCG; the top 24 bits make a float in [0, 1) */
+float nextRandom(unsigned int *seed){
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) / 16777216.0f;
+}
+
+/* Replace the spheres with n of random size and material scattered over the
+ * whole image; the same n always gives the same scene */
+void generateScene(scene *sc, int n){
+	unsigned int seed = 1;
+	sphere s;
+	int i;
+	clearSceneSpheres(sc);
+	for(i = 0; i < n; i++){
+		s.pos.x = nextRandom(&seed) * WIDTH;
+		s.pos.y = nextRandom(&seed) * imageHeight;
+		s.pos.z = nextRandom(&seed) * 1000;
+		s.radius = 10 + nextRandom(&seed) * 90;
+		s.material = i % 3;
+		addSceneSphere(sc, &s);
+	}
+}
+
+/* The ray the camera sends through pixel (x, y) */
+void primaryRay(int x, int y, ray *r){
+	r->start.x = x;
+	r->start.y = y;
+	r->start.z = -2000;
+	
+	r->dir.x = 0;
+	r->dir.y = 0;
+	r->dir.z = 1;
+}
+
+/* closestSphere over the given spheres only, in increasing index order */
+int closestCandidate(ray *r, float *t, const int *candidates, int numCandidates){
+	int currentSphere = -1;
+	int i;
+	for(i = 0; i < numCandidates; i++){
+		if(intersectRaySphere(r, candidates[i], t))
+			currentSphere = candidates[i];
+	}
+	return currentSphere;
+}
+
+/* Screen grid: for each tile of the image, the spheres a primary ray of the
+ * tile might hit, in increasing index order.  The camera looks along z
+ * without perspective, so sphere s can only be hit by the rays within its
+ * radius of (x, y) of its centre.  Tile t's spheres are
+ * gridSpheres[gridStart[t]] up to gridSpheres[gridStart[t + 1]] */
+int *gridStart = NULL;
+int *gridSpheres;
+int gridEmpty;		/* tiles no primary ray of which hits anything */
+
+/* Bound on how far from its centre a ray from z = cameraZ can still hit
+ * sphere s when the quadratic is solved in floats; the discriminant loses
+ * about distance^2 / 2^24 to rounding, and the slack here is generous */
+float gridReach(int s, float cameraZ){
+	float distance = fabsf(sphereZ[s] - cameraZ) + sphereRadius[s];
+	return sqrtf(sphereR2[s] + distance * distance * 1e-5f) + 1.0f;
+}
+
+/* The grid only holds while primary rays all point along z from a plane
+ * of constant z through their pixel; another camera goes without it */
+bool gridApplies(){
+	ray a, b;
+	primaryRay(0, 0, &a);
+	primaryRay(WIDTH - 1, imageHeight - 1, &b);
+	return a.dir.x == 0 && a.dir.y == 0 && a.dir.z > 0
+	       && b.dir.x == 0 && b.dir.y == 0 && b.dir.z == a.dir.z
+	       && a.start.x == 0 && a.start.y == 0 && a.start.z == b.start.z
+	       && b.start.x == WIDTH - 1 && b.start.y == imageHeight - 1;
+}
+
+/* Tiles x0 <= x <= x1, y0 <= y <= y1 covered by sphere s, or false if it
+ * lies off the image */
+bool gridFootprint(int s, float cameraZ, int *x0, int *x1, int *y0, int *y1){
+	float reach = gridReach(s, cameraZ);
+	float left = ceilf(sphereX[s] - reach), right = floorf(sphereX[s] + reach);
+	float top = ceilf(sphereY[s] - reach), bottom = floorf(sphereY[s] + reach);
+	if(!(left <= WIDTH - 1 && right >= 0 && top <= imageHeight - 1 && bottom >= 0 && left <= right && top <= bottom))
+		return false;
+	*x0 = (int) fmaxf(left, 0) / TILE_WIDTH;
+	*x1 = (int) fminf(right, WIDTH - 1) / TILE_WIDTH;
+	*y0 = (int) fmaxf(top, 0) / TILE_HEIGHT;
+	*y1 = (int) fminf(bottom, imageHeight - 1) / TILE_HEIGHT;
+	return true;
+}
+
+/* Count the spheres of every tile, then list them; returns false, leaving
+ * no grid, if the lists would not fit */
+bool buildScreenGrid(){
+	int tilesX = (WIDTH + TILE_WIDTH - 1) / TILE_WIDTH;
+	int tilesY = (imageHeight + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	size_t tiles = (size_t) tilesX * tilesY;
+	int x0, x1, y0, y1, tx, ty, s;
+	size_t t, total = 0;
+	ray camera;
+	
+	primaryRay(0, 0, &camera);
+	gridStart = calloc(tiles + 1, sizeof(int));
+	int *cursor = malloc(tiles * sizeof(int));
+	if(gridStart == NULL || cursor == NULL){
+		free(gridStart); free(cursor);
+		gridStart = NULL;
+		return false;
+	}
+	for(s = 0; s < numSpheres; s++){
+		if(!gridFootprint(s, camera.start.z, &x0, &x1, &y0, &y1))
+			continue;
+		for(ty = y0; ty <= y1; ty++)
+			for(tx = x0; tx <= x1; tx++)
+				gridStart[(size_t) ty * tilesX + tx + 1]++;
+		total += (size_t) (x1 - x0 + 1) * (y1 - y0 + 1);
+	}
+	gridSpheres = total < INT_MAX ? malloc((total + 1) * sizeof(int)) : NULL;
+	if(gridSpheres == NULL){
+		free(gridStart); free(cursor);
+		gridStart = NULL;
+		return false;
+	}
+	gridEmpty = 0;
+	for(t = 0; t < tiles; t++){
+		gridEmpty += gridStart[t + 1] == 0;
+		gridStart[t + 1] += gridStart[t];
+		cursor[t] = gridStart[t];
+	}
+	for(s = 0; s < numSpheres; s++){
+		if(!gridFootprint(s, camera.start.z, &x0, &x1, &y0, &y1))
+			continue;
+		for(ty = y0; ty <= y1; ty++)
+			for(tx = x0; tx <= x1; tx++)
+				gridSpheres[cursor[(size_t) ty * tilesX + tx]++] = s;
+	}
+	free(cursor);
+	return true;
+}
+
+/* Find the sphere r hits first, as the trace mode asks; candidates, if not
+ * NULL, are the only spheres r can hit */
+int findClosest(ray *r, float *t, const int *candidates, int numCandidates){
+	return candidates != NULL ? closestCandidate(r, t, candidates, numCandidates)
+	       : bvhNodes != NULL ? closestSphereBvh(r, t)
+	       : traceMode == TRACE_SPHERES ? closestSphereAvx2(r, t) : closestSphere(r, t);
+}
+
+/* Light the point where r hits currentSphere at distance t, adding to the
+ * colour c, then turn r into the reflected ray and scale coef by the
+ * reflection.  Returns false if the hit is degenerate and tracing stops */
+bool shadeHit(ray *r, float t, int currentSphere, float *coef, colour *c){
+	vector scaled = vectorScale(t, &r->dir);
+	vector newStart = vectorAdd(&r->start, &scaled);
+	
+	/* Find the normal for this new vector at the point of intersection */
+	vector pos = {sphereX[currentSphere], sphereY[currentSphere], sphereZ[currentSphere]};
+	vector n = vectorSub(&newStart, &pos);
+	float temp = vectorDot(&n, &n);
+	if(temp == 0) return false;
+	
+	temp = 1.0f / sqrtf(temp);
+	n = vectorScale(temp, &n);
+
+	/* Find the material to determine the colour */
+	material currentMat = materials[sphereMaterial[currentSphere]];
+	
+	/* Find the value of the light at this point */
+	unsigned int j;
+	for(j=0; j < numLights; j++){
+		light currentLight = lights[j];
+		vector dist = vectorSub(&currentLight.pos, &newStart);
+		if(vectorDot(&n, &dist) <= 0.0f) continue;
+		float t = sqrtf(vectorDot(&dist,&dist));
+		if(t <= 0.0f) continue;
+		
+		ray lightRay;
+		lightRay.start = newStart;
+		lightRay.dir = vectorScale((1/t), &dist);
+		
+		/* Lambert diffusion */
+		float lambert = vectorDot(&lightRay.dir, &n) * *coef; 
+		c->red += lambert * currentLight.intensity.red * currentMat.diffuse.red;
+		c->green += lambert * currentLight.intensity.green * currentMat.diffuse.green;
+		c->blue += lambert * currentLight.intensity.blue * currentMat.diffuse.blue;
+	}
+	/* Iterate over the reflection */
+	*coef *= currentMat.reflection;
+	
+	/* The reflected ray start and direction */
+	r->start = newStart;
+	float reflect = 2.0f * vectorDot(&r->dir, &n);
+	vector tmp = vectorScale(reflect, &n);
+	r->dir = vectorSub(&r->dir, &tmp);
+	return true;
+}
+
+/* Trace the ray through pixel (x, y) and its reflections, and store the
+ * colour in line, which holds row y of the image.  If candidates is not
+ * NULL, the ray through the pixel can only hit those spheres */
+void tracePixel(int x, int y, unsigned char *line, const int *candidates, int numCandidates){
+	ray r;
+	
+	colour c = {0, 0, 0};
+	
+	int level = 0;
+	float coef = 1.0;
+	
+	primaryRay(x, y, &r);
+	
+	do{
+		/* Find closest intersection */
+		float t = 20000.0f;
+		int currentSphere = findClosest(&r, &t, level == 0 ? candidates : NULL, numCandidates);
+		if(currentSphere == -1) break;
+		
+		if(!shadeHit(&r, t, currentSphere, &coef, &c)) break;
+		
+		level++;
+
+	}while((coef > 0.0f) && (level < 15));
+	
+	line[x*3 + 0] = (unsigned char)min(c.red*255.0f, 255.0f);
+	line[x*3 + 1] = (unsigned char)min(c.green*255.0f, 255.0f);
+	line[x*3 + 2] = (unsigned char)min(c.blue*255.0f, 255.0f);
+}
+
+/* Rays traced together, one bounce at a time: a row of a tile in the
+ * packet mode, or a whole tile in the wavefront mode.  Stored as separate
+ * arrays so that 8 consecutive rays load straight into an AVX register;
+ * rays that stop are dropped between bounces so the packets stay full */
+#define STREAM_RAYS (TILE_WIDTH * TILE_HEIGHT)
+
+typedef struct{
+	float sx[STREAM_RAYS], sy[STREAM_RAYS], sz[STREAM_RAYS];
+	float dx[STREAM_RAYS], dy[STREAM_RAYS], dz[STREAM_RAYS];
+	float coef[STREAM_RAYS];
+	float red[STREAM_RAYS], green[STREAM_RAYS], blue[STREAM_RAYS];
+	float t[STREAM_RAYS];		/* distance to the hit found by the intersect stage */
+	int sphere[STREAM_RAYS];	/* sphere hit, or -1 */
+	int pixel[STREAM_RAYS];		/* pixel the ray belongs to, counted from the start of its output */
+	int count;
+}rayStream;
+
+/* Store the colour of the index'th ray of the stream at its pixel in out */
+void storeColour(rayStream *s, int index, unsigned char *out){
+	int pixel = s->pixel[index];
+	out[pixel*3 + 0] = (unsigned char)min(s->red[index]*255.0f, 255.0f);
+	out[pixel*3 + 1] = (unsigned char)min(s->green[index]*255.0f, 255.0f);
+	out[pixel*3 + 2] = (unsigned char)min(s->blue[index]*255.0f, 255.0f);
+}
+
+/* Start ray index of the stream at pixel (x, y), stored at pixel of out */
+void startRay(rayStream *s, int index, int x, int y, int pixel){
+	ray r;
+	primaryRay(x, y, &r);
+	s->sx[index] = r.start.x;
+	s->sy[index] = r.start.y;
+	s->sz[index] = r.start.z;
+	s->dx[index] = r.dir.x;
+	s->dy[index] = r.dir.y;
+	s->dz[index] = r.dir.z;
+	s->coef[index] = 1.0;
+	s->red[index] = s->green[index] = s->blue[index] = 0;
+	s->pixel[index] = pixel;
+}
+
+/* Finished rays (keep[i] clear, or every ray if last is set) leave their
+ * colour in out; the rest close ranks */
+void retireRays(rayStream *s, const int *keep, bool last, unsigned char *out){
+	int live = 0;
+	int i;
+	for(i = 0; i < s->count; i++){
+		if(!keep[i] || last){
+			storeColour(s, i, out);
+			continue;
+		}
+		if(live == i){
+			live++;
+			continue;
+		}
+		s->sx[live] = s->sx[i]; s->sy[live] = s->sy[i]; s->sz[live] = s->sz[i];
+		s->dx[live] = s->dx[i]; s->dy[live] = s->dy[i]; s->dz[live] = s->dz[i];
+		s->coef[live] = s->coef[i];
+		s->red[live] = s->red[i]; s->green[live] = s->green[i]; s->blue[live] = s->blue[i];
+		s->t[live] = s->t[i]; s->sphere[live] = s->sphere[i];
+		s->pixel[live] = s->pixel[i];
+		live++;
+	}
+	s->count = live;
+}
+
+/* The two stages of a bounce, 8 rays at a time: intersectAvx2 finds the
+ * sphere each ray hits first, among the given spheres or all of them if
+ * candidates is NULL; shadeAvx2 lights the hits, reflects the rays and sets
+ * alive[i] for the rays that go on to another bounce.  Each lane performs the
+ * same float operations in the same order as tracePixel, and the comparisons
+ * treat NaN as the scalar code does, so the colours are bit-identical.
+ * Lanes past the end of the stream take part but change nothing */
+__attribute__((target("avx2")))
+void intersectAvx2(rayStream *s, const int *candidates, int numCandidates){
+	const __m256 two = _mm256_set1_ps(2.0f);
+	const __m256 four = _mm256_set1_ps(4.0f);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	int k;
+	
+	for(k = 0; k < s->count; k += 8){
+		__m256i lane = _mm256_add_epi32(_mm256_set1_epi32(k), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(s->count), lane));
+		
+		__m256 sx = _mm256_loadu_ps(&s->sx[k]), sy = _mm256_loadu_ps(&s->sy[k]), sz = _mm256_loadu_ps(&s->sz[k]);
+		__m256 dx = _mm256_loadu_ps(&s->dx[k]), dy = _mm256_loadu_ps(&s->dy[k]), dz = _mm256_loadu_ps(&s->dz[k]);
+		const __m256 sign = _mm256_set1_ps(-0.0f);
+		
+		/* Find closest intersection */
+		__m256 t = _mm256_set1_ps(20000.0f);
+		__m256i currentSphere = _mm256_set1_epi32(-1);
+		int i, next;
+		__m256 fourA = _mm256_mul_ps(four, dot8(dx, dy, dz, dx, dy, dz));
+		for(next = 0; next < (candidates != NULL ? numCandidates : numSpheres); next++){
+			i = candidates != NULL ? candidates[next] : next;
+			__m256 distx = _mm256_sub_ps(sx, _mm256_set1_ps(sphereX[i]));
+			__m256 disty = _mm256_sub_ps(sy, _mm256_set1_ps(sphereY[i]));
+			__m256 distz = _mm256_sub_ps(sz, _mm256_set1_ps(sphereZ[i]));
+			__m256 B = _mm256_mul_ps(two, dot8(dx, dy, dz, distx, disty, distz));
+			__m256 C = _mm256_sub_ps(dot8(distx, disty, distz, distx, disty, distz), _mm256_set1_ps(sphereR2[i]));
+			__m256 discr = _mm256_sub_ps(_mm256_mul_ps(B, B), _mm256_mul_ps(fourA, C));
+			
+			/* A negative discriminant gives a NaN root, which fails the
+			 * range test below just as the scalar early return does */
+			__m256 sqrtdiscr = _mm256_sqrt_ps(discr);
+			__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(sqrtdiscr, B), half);
+			__m256 t1 = _mm256_mul_ps(_mm256_xor_ps(_mm256_add_ps(B, sqrtdiscr), sign), half);
+			t0 = _mm256_blendv_ps(t0, t1, _mm256_cmp_ps(t0, t1, _CMP_GT_OQ));
+			
+			__m256 hit = _mm256_and_ps(active, _mm256_and_ps(_mm256_cmp_ps(t0, _mm256_set1_ps(0.001f), _CMP_GT_OQ),
+			                                                 _mm256_cmp_ps(t0, t, _CMP_LT_OQ)));
+			t = _mm256_blendv_ps(t, t0, hit);
+			currentSphere = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(currentSphere),
+			                                                    _mm256_castsi256_ps(_mm256_set1_epi32(i)), hit));
+		}
+		
+		_mm256_storeu_ps(&s->t[k], t);
+		_mm256_storeu_si256((__m256i *) &s->sphere[k], currentSphere);
+	}
+}
+
+__attribute__((target("avx2")))
+void shadeAvx2(rayStream *s, int *alive){
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 two = _mm256_set1_ps(2.0f);
+	int i, k;
+	
+	for(k = 0; k < s->count; k += 8){
+		__m256i lane = _mm256_add_epi32(_mm256_set1_epi32(k), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(s->count), lane));
+		
+		__m256 sx = _mm256_loadu_ps(&s->sx[k]), sy = _mm256_loadu_ps(&s->sy[k]), sz = _mm256_loadu_ps(&s->sz[k]);
+		__m256 dx = _mm256_loadu_ps(&s->dx[k]), dy = _mm256_loadu_ps(&s->dy[k]), dz = _mm256_loadu_ps(&s->dz[k]);
+		__m256 coef = _mm256_loadu_ps(&s->coef[k]);
+		__m256 t = _mm256_loadu_ps(&s->t[k]);
+		__m256i currentSphere = _mm256_loadu_si256((__m256i *) &s->sphere[k]);
+		__m256 found = _mm256_and_ps(active, _mm256_castsi256_ps(_mm256_cmpgt_epi32(currentSphere, _mm256_set1_epi32(-1))));
+		
+		__m256 newx = _mm256_add_ps(sx, _mm256_mul_ps(dx, t));
+		__m256 newy = _mm256_add_ps(sy, _mm256_mul_ps(dy, t));
+		__m256 newz = _mm256_add_ps(sz, _mm256_mul_ps(dz, t));
+		
+		/* Find the normal for this new vector at the point of intersection */
+		__m256 nx = _mm256_sub_ps(newx, _mm256_mask_i32gather_ps(zero, sphereX, currentSphere, found, 4));
+		__m256 ny = _mm256_sub_ps(newy, _mm256_mask_i32gather_ps(zero, sphereY, currentSphere, found, 4));
+		__m256 nz = _mm256_sub_ps(newz, _mm256_mask_i32gather_ps(zero, sphereZ, currentSphere, found, 4));
+		__m256 temp = dot8(nx, ny, nz, nx, ny, nz);
+		__m256 live = _mm256_and_ps(found, _mm256_cmp_ps(temp, zero, _CMP_NEQ_UQ));
+		
+		temp = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(temp));
+		nx = _mm256_mul_ps(nx, temp);
+		ny = _mm256_mul_ps(ny, temp);
+		nz = _mm256_mul_ps(nz, temp);
+		
+		/* Find the material to determine the colour */
+		__m256i mat = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), sphereMaterial, currentSphere,
+		                                         _mm256_castps_si256(found), 4);
+		mat = _mm256_mullo_epi32(mat, _mm256_set1_epi32(sizeof(material) / sizeof(float)));
+		const float *materialData = (const float *) materials;
+		__m256 diffuseRed = _mm256_mask_i32gather_ps(zero, materialData, mat, found, 4);
+		__m256 diffuseGreen = _mm256_mask_i32gather_ps(zero, materialData + 1, mat, found, 4);
+		__m256 diffuseBlue = _mm256_mask_i32gather_ps(zero, materialData + 2, mat, found, 4);
+		__m256 reflection = _mm256_mask_i32gather_ps(zero, materialData + 3, mat, found, 4);
+		
+		/* Find the value of the light at this point */
+		__m256 red = _mm256_loadu_ps(&s->red[k]), green = _mm256_loadu_ps(&s->green[k]), blue = _mm256_loadu_ps(&s->blue[k]);
+		int j;
+		for(j = 0; j < numLights; j++){
+			__m256 distx = _mm256_sub_ps(_mm256_set1_ps(lights[j].pos.x), newx);
+			__m256 disty = _mm256_sub_ps(_mm256_set1_ps(lights[j].pos.y), newy);
+			__m256 distz = _mm256_sub_ps(_mm256_set1_ps(lights[j].pos.z), newz);
+			__m256 lit = _mm256_and_ps(live, _mm256_cmp_ps(dot8(nx, ny, nz, distx, disty, distz), zero, _CMP_NLE_UQ));
+			__m256 tl = _mm256_sqrt_ps(dot8(distx, disty, distz, distx, disty, distz));
+			lit = _mm256_and_ps(lit, _mm256_cmp_ps(tl, zero, _CMP_NLE_UQ));
+			
+			__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.0f), tl);
+			__m256 lambert = _mm256_mul_ps(dot8(_mm256_mul_ps(distx, inv), _mm256_mul_ps(disty, inv),
+			                                    _mm256_mul_ps(distz, inv), nx, ny, nz), coef);
+			red = _mm256_blendv_ps(red, _mm256_add_ps(red, _mm256_mul_ps(_mm256_mul_ps(lambert,
+			                       _mm256_set1_ps(lights[j].intensity.red)), diffuseRed)), lit);
+			green = _mm256_blendv_ps(green, _mm256_add_ps(green, _mm256_mul_ps(_mm256_mul_ps(lambert,
+			                         _mm256_set1_ps(lights[j].intensity.green)), diffuseGreen)), lit);
+			blue = _mm256_blendv_ps(blue, _mm256_add_ps(blue, _mm256_mul_ps(_mm256_mul_ps(lambert,
+			                        _mm256_set1_ps(lights[j].intensity.blue)), diffuseBlue)), lit);
+		}
+		_mm256_storeu_ps(&s->red[k], red);
+		_mm256_storeu_ps(&s->green[k], green);
+		_mm256_storeu_ps(&s->blue[k], blue);
+		
+		/* Iterate over the reflection */
+		__m256 newCoef = _mm256_mul_ps(coef, reflection);
+		
+		/* The reflected ray start and direction */
+		__m256 reflect = _mm256_mul_ps(two, dot8(dx, dy, dz, nx, ny, nz));
+		_mm256_storeu_ps(&s->sx[k], _mm256_blendv_ps(sx, newx, live));
+		_mm256_storeu_ps(&s->sy[k], _mm256_blendv_ps(sy, newy, live));
+		_mm256_storeu_ps(&s->sz[k], _mm256_blendv_ps(sz, newz, live));
+		_mm256_storeu_ps(&s->dx[k], _mm256_blendv_ps(dx, _mm256_sub_ps(dx, _mm256_mul_ps(nx, reflect)), live));
+		_mm256_storeu_ps(&s->dy[k], _mm256_blendv_ps(dy, _mm256_sub_ps(dy, _mm256_mul_ps(ny, reflect)), live));
+		_mm256_storeu_ps(&s->dz[k], _mm256_blendv_ps(dz, _mm256_sub_ps(dz, _mm256_mul_ps(nz, reflect)), live));
+		_mm256_storeu_ps(&s->coef[k], _mm256_blendv_ps(coef, newCoef, live));
+		
+		int more = _mm256_movemask_ps(_mm256_and_ps(live, _mm256_cmp_ps(newCoef, zero, _CMP_GT_OQ)));
+		for(i = 0; i < 8; i++){
+			alive[k + i] = (more >> i) & 1;
+		}
+	}
+}
+
+/* Trace the pixels x0 <= x < x1 of row y, held in line, as a stream of
+ * 8-wide packets; candidates are as for tracePixel */
+void traceRowAvx2(int x0, int x1, int y, unsigned char *line, const int *candidates, int numCandidates){
+	rayStream s;
+	int alive[TILE_WIDTH + 8];
+	int level, i;
+	
+	s.count = x1 - x0;
+	for(i = 0; i < s.count; i++)
+		startRay(&s, i, x0 + i, y, x0 + i);
+	
+	for(level = 0; level < 15 && s.count > 0; level++){
+		intersectAvx2(&s, level == 0 ? candidates : NULL, numCandidates);
+		shadeAvx2(&s, alive);
+		retireRays(&s, alive, level == 14, line);
+	}
+}
+
+/* Trace the pixels x0 <= x < x1 of rows y0 <= y < y1 of the band starting at
+ * firstRow as one wavefront.  Every bounce runs as stages over the whole
+ * stream: intersect, drop the rays that missed, then shade and spawn the
+ * reflections, and drop the rays that are done.  Only live rays reach each
+ * stage, so its kernel works on full vectors of rays at the same depth */
+void traceWavefront(int x0, int x1, int y0, int y1, int firstRow, unsigned char *band,
+                    const int *candidates, int numCandidates){
+	rayStream s;
+	int keep[STREAM_RAYS];
+	int level, i, x, y;
+	bool vector = traceMode != TRACE_SCALAR;
+	
+	s.count = 0;
+	for(y = y0; y < y1; y++)
+		for(x = x0; x < x1; x++)
+			startRay(&s, s.count++, x, firstRow + y, y * WIDTH + x);
+	
+	for(level = 0; level < 15 && s.count > 0; level++){
+		const int *spheres = level == 0 ? candidates : NULL;
+		
+		/* Intersect: 8 rays against each sphere where there are few
+		 * spheres, otherwise one ray at a time through the search */
+		if(traceMode == TRACE_PACKETS && (bvhNodes == NULL || spheres != NULL)){
+			intersectAvx2(&s, spheres, numCandidates);
+		}else{
+			for(i = 0; i < s.count; i++){
+				ray r = {{s.sx[i], s.sy[i], s.sz[i]}, {s.dx[i], s.dy[i], s.dz[i]}};
+				s.t[i] = 20000.0f;
+				s.sphere[i] = findClosest(&r, &s.t[i], spheres, numCandidates);
+			}
+		}
+		for(i = 0; i < s.count; i++)
+			keep[i] = s.sphere[i] != -1;
+		retireRays(&s, keep, false, band);
+		
+		/* Shade and spawn the reflected rays */
+		if(vector){
+			shadeAvx2(&s, keep);
+		}else{
+			for(i = 0; i < s.count; i++){
+				ray r = {{s.sx[i], s.sy[i], s.sz[i]}, {s.dx[i], s.dy[i], s.dz[i]}};
+				colour c = {s.red[i], s.green[i], s.blue[i]};
+				keep[i] = shadeHit(&r, s.t[i], s.sphere[i], &s.coef[i], &c) && s.coef[i] > 0.0f;
+				s.sx[i] = r.start.x; s.sy[i] = r.start.y; s.sz[i] = r.start.z;
+				s.dx[i] = r.dir.x; s.dy[i] = r.dir.y; s.dz[i] = r.dir.z;
+				s.red[i] = c.red; s.green[i] = c.green; s.blue[i] = c.blue;
+			}
+		}
+		retireRays(&s, keep, level == 14, band);
+	}
+}
+
+/* Render the tile'th tile of the band of rows starting at firstRow,
+ * counting across then down the band */
+void renderTile(int tile, int firstRow, int rows, unsigned char *band){
+	int tilesX = (WIDTH + TILE_WIDTH - 1) / TILE_WIDTH;
+	int x0 = (tile % tilesX) * TILE_WIDTH;
+	int y0 = (tile / tilesX) * TILE_HEIGHT;
+	int x, y;
+	
+	/* Bands start on a tile boundary, so the tile is one of the grid's.
+	 * Where no sphere can be hit the tile is background; where too many
+	 * can, the BVH finds the hits faster than the list would */
+	const int *candidates = NULL;
+	int numCandidates = 0;
+	if(gridStart != NULL){
+		size_t cell = (size_t) ((firstRow + y0) / TILE_HEIGHT) * tilesX + tile % tilesX;
+		numCandidates = gridStart[cell + 1] - gridStart[cell];
+		if(numCandidates == 0){
+			for(y = y0; y < min(y0 + TILE_HEIGHT, rows); y++)
+				memset(band + ((size_t) y * WIDTH + x0) * 3, 0, (min(x0 + TILE_WIDTH, WIDTH) - x0) * 3);
+			return;
+		}
+		if(numCandidates <= BVH_MIN_SPHERES || bvhNodes == NULL)
+			candidates = gridSpheres + gridStart[cell];
+	}
+	
+	if(wavefrontMode){
+		traceWavefront(x0, min(x0 + TILE_WIDTH, WIDTH), y0, min(y0 + TILE_HEIGHT, rows), firstRow, band,
+		               candidates, numCandidates);
+		return;
+	}
+	for(y = y0; y < min(y0 + TILE_HEIGHT, rows); y++){
+		unsigned char *line = band + (size_t) y * WIDTH * 3;
+		if(traceMode == TRACE_PACKETS && bvhNodes == NULL){
+			traceRowAvx2(x0, min(x0 + TILE_WIDTH, WIDTH), firstRow + y, line, candidates, numCandidates);
+			continue;
+		}
+		for(x = x0; x < min(x0 + TILE_WIDTH, WIDTH); x++){
+			tracePixel(x, firstRow + y, line, candidates, numCandidates);
+		}
+	}
+}
+
+/* Render rows firstRow <= y < firstRow + rows into band.  Called from a
+ * task of a parallel region; the tiles become tasks for the whole team.
+ * Every pixel is traced exactly as in the sequential version, so the image
+ * is identical whatever the number of threads */
+void renderBand(int firstRow, int rows, unsigned char *band){
+	int tiles = ((WIDTH + TILE_WIDTH - 1) / TILE_WIDTH) * ((rows + TILE_HEIGHT - 1) / TILE_HEIGHT);
+	int tile;
+	#pragma omp taskloop grainsize(1)
+	for(tile = 0; tile < tiles; tile++){
+		renderTile(tile, firstRow, rows, band);
+	}
+}
+
+int main(int argc, char *argv[]){
+
+	int mode = TRACE_PACKETS;
+	int generated = 0;
+	char *sceneFile = NULL;
+	scene world;
+	int c;
+	bool linear = false;
+	bool grid = true;
+	int bandRows = 0;
+	while((c = getopt(argc, argv, "swg:lf:H:b:nv")) != -1){
+		switch(c){
+			case 's':
+				mode = TRACE_SCALAR;
+				break;
+			case 'w':
+				mode = TRACE_SPHERES;
+				break;
+			case 'g':
+				generated = atoi(optarg);
+				break;
+			case 'l':
+				linear = true;
+				break;
+			case 'n':
+				grid = false;
+				break;
+			case 'v':
+				wavefrontMode = true;
+				break;
+			case 'f':
+				sceneFile = optarg;
+				break;
+			case 'H':
+				imageHeight = atoi(optarg);
+				if(imageHeight <= 0){
+					printf("%s: option requires an argument > 0 -- 'H'\n", argv[0]);
+					return 1;
+				}
+				break;
+			case 'b':
+				bandRows = atoi(optarg);
+				if(bandRows <= 0){
+					printf("%s: option requires an argument > 0 -- 'b'\n", argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				return 1;
+		}
+	}
+	
+	__builtin_cpu_init();
+	traceMode = __builtin_cpu_supports("avx2") ? mode : TRACE_SCALAR;
+	
+	/* A scene file (text, or binary as written by scene_convert) replaces
+	 * the built-in scene; -g replaces only its spheres */
+	if(sceneFile != NULL){
+		if(generated > 0){
+			printf("-g cannot be combined with -f\n");
+			return 1;
+		}
+		double start = omp_get_wtime();
+		if(loadScene(sceneFile, &world) < 0)
+			return 1;
+		printf("Loaded %d spheres from %s in %.3f s\n", world.numSpheres, sceneFile, omp_get_wtime() - start);
+	}else{
+		setupScene(&world);
+		if(generated > 0)
+			generateScene(&world, generated);
+	}
+	useScene(&world);
+	
+	/* Larger scenes are searched through a BVH one ray at a time, unless
+	 * -l asks for the linear search */
+	if(numSpheres > BVH_MIN_SPHERES && !linear){
+		double start = omp_get_wtime();
+		buildBvh();
+		printf("Built a BVH of %d nodes over %d spheres in %.3f s\n", bvhNodeCount, numSpheres, omp_get_wtime() - start);
+	}
+	
+	/* Primary rays look up the spheres they can hit in the screen grid,
+	 * unless -n asks for the full search or the camera rules the grid out */
+	if(grid && gridApplies()){
+		double start = omp_get_wtime();
+		if(buildScreenGrid()){
+			int tiles = ((WIDTH + TILE_WIDTH - 1) / TILE_WIDTH) * ((imageHeight + TILE_HEIGHT - 1) / TILE_HEIGHT);
+			printf("Built a screen grid of %d tiles, %d of them empty, in %.3f s\n", tiles, gridEmpty, omp_get_wtime() - start);
+		}
+	}
+	
+	/* The image is rendered in bands of bandRows rows (by default one band
+	 * for the whole image) into two buffers.  While one band is written to
+	 * the file by a task, the next is rendered into the other buffer, so
+	 * memory stays at two bands however tall the image */
+	if(bandRows == 0 || bandRows > imageHeight)
+		bandRows = imageHeight;
+	bandRows = (bandRows + TILE_HEIGHT - 1) / TILE_HEIGHT * TILE_HEIGHT;
+	int numBuffers = bandRows < imageHeight ? 2 : 1;
+	unsigned char *bands[2];
+	for(c = 0; c < numBuffers; c++){
+		bands[c] = malloc((size_t) 3 * WIDTH * bandRows);
+		if(bands[c] == NULL){
+			printf("Unable to allocate bands of %d rows\n", bandRows);
+			return 1;
+		}
+	}
+	FILE *f = openppm("image.ppm", WIDTH, imageHeight);
+	if(f == NULL){
+		printf("Unable to open image.ppm\n");
+		return 1;
+	}
+	bool writeFailed = false;
+	
+	#pragma omp parallel
+	#pragma omp single
+	{
+		int firstRow;
+		for(firstRow = 0; firstRow < imageHeight; firstRow += bandRows){
+			unsigned char *band = bands[(firstRow / bandRows) % numBuffers];
+			int rows = min(bandRows, imageHeight - firstRow);
+			renderBand(firstRow, rows, band);
+			
+			/* The band before is on disk once its task is done, so its
+			 * buffer is free for the band after this one */
+			#pragma omp taskwait
+			#pragma omp task firstprivate(band, rows) shared(writeFailed)
+			{
+				/* Write the image data to the file - remember 3 byte per pixel */
+				if(fwrite(band, 3, (size_t) WIDTH * rows, f) != (size_t) WIDTH * rows)
+					writeFailed = true;
+			}
+		}
+	}
+	
+	/* Make sure you close the file */
+	if(fclose(f) != 0 || writeFailed){
+		printf("Unable to write image.ppm\n");
+		return 1;
+	}
+	
+	for(c = 0; c < numBuffers; c++)
+		free(bands[c]);
+	freeScene(&world);
+	return 0;
+}
@@ -0,0 +1,349 @@
+/* Reading, writing and mapping scenes; see scene.h for the two forms */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "scene.h"
+
+#define roundUp(n, multiple) (((n) + (multiple) - 1) / (multiple) * (multiple))
+
+/* Number of arrays in a binary scene: six per sphere field, then the
+ * materials and the lights */
+#define SCENE_SECTIONS 8
+
+void initScene(scene *sc){
+	memset(sc, 0, sizeof(*sc));
+}
+
+/* Make room for at least n spheres.  The arrays are reallocated together
+ * and the room past the last sphere is zeroed, to keep the padding clean */
+static void reserveSpheres(scene *sc, int n){
+	float **fields[5] = {&sc->sphereX, &sc->sphereY, &sc->sphereZ, &sc->sphereRadius, &sc->sphereR2};
+	int capacity = sc->capacity > 0 ? sc->capacity : 4 * SCENE_PAD;
+	int k;
+	if(n <= sc->capacity)
+		return;
+	while(capacity < n)
+		capacity *= 2;
+	for(k = 0; k < 6; k++){
+		void **field = k < 5 ? (void **) fields[k] : (void **) &sc->sphereMaterial;
+		void *grown;
+		if(posix_memalign(&grown, SCENE_ALIGN, capacity * sizeof(float))){
+			printf("Unable to allocate %d spheres\n", capacity);
+			exit(1);
+		}
+		memset(grown, 0, capacity * sizeof(float));
+		if(*field != NULL)
+			memcpy(grown, *field, sc->numSpheres * sizeof(float));
+		free(*field);
+		*field = grown;
+	}
+	sc->capacity = capacity;
+}
+
+void addSceneSphere(scene *sc, sphere *s){
+	reserveSpheres(sc, sc->numSpheres + 1);
+	sc->sphereX[sc->numSpheres] = s->pos.x;
+	sc->sphereY[sc->numSpheres] = s->pos.y;
+	sc->sphereZ[sc->numSpheres] = s->pos.z;
+	sc->sphereRadius[sc->numSpheres] = s->radius;
+	sc->sphereR2[sc->numSpheres] = s->radius * s->radius;
+	sc->sphereMaterial[sc->numSpheres] = s->material;
+	sc->numSpheres++;
+}
+
+void addSceneMaterial(scene *sc, material *m){
+	sc->materials = realloc(sc->materials, (sc->numMaterials + 1) * sizeof(material));
+	sc->materials[sc->numMaterials++] = *m;
+}
+
+void addSceneLight(scene *sc, light *l){
+	sc->lights = realloc(sc->lights, (sc->numLights + 1) * sizeof(light));
+	sc->lights[sc->numLights++] = *l;
+}
+
+void clearSceneSpheres(scene *sc){
+	if(sc->capacity > 0){
+		memset(sc->sphereX, 0, sc->numSpheres * sizeof(float));
+		memset(sc->sphereY, 0, sc->numSpheres * sizeof(float));
+		memset(sc->sphereZ, 0, sc->numSpheres * sizeof(float));
+		memset(sc->sphereRadius, 0, sc->numSpheres * sizeof(float));
+		memset(sc->sphereR2, 0, sc->numSpheres * sizeof(float));
+		memset(sc->sphereMaterial, 0, sc->numSpheres * sizeof(int));
+	}
+	sc->numSpheres = 0;
+}
+
+void freeScene(scene *sc){
+	if(sc->mapping != NULL){
+		munmap(sc->mapping, sc->mappingSize);
+	}else{
+		free(sc->sphereX); free(sc->sphereY); free(sc->sphereZ);
+		free(sc->sphereRadius); free(sc->sphereR2); free(sc->sphereMaterial);
+		free(sc->materials); free(sc->lights);
+	}
+	initScene(sc);
+}
+
+int checkScene(scene *sc){
+	int i;
+	for(i = 0; i < sc->numSpheres; i++){
+		if(sc->sphereMaterial[i] < 0 || sc->sphereMaterial[i] >= sc->numMaterials){
+			printf("Sphere %d uses material %d, but the scene has %d materials\n",
+			       i, sc->sphereMaterial[i], sc->numMaterials);
+			return -1;
+		}
+		if(!isfinite(sc->sphereX[i]) || !isfinite(sc->sphereY[i]) || !isfinite(sc->sphereZ[i])){
+			printf("Sphere %d is at (%g, %g, %g)\n", i, sc->sphereX[i], sc->sphereY[i], sc->sphereZ[i]);
+			return -1;
+		}
+		if(!isfinite(sc->sphereRadius[i]) || !(sc->sphereRadius[i] > 0)){
+			printf("Sphere %d has radius %g\n", i, sc->sphereRadius[i]);
+			return -1;
+		}
+		/* A mapped scene is used as it is, so its squares are not ours */
+		if(!isfinite(sc->sphereR2[i]) || sc->sphereR2[i] != sc->sphereRadius[i] * sc->sphereRadius[i]){
+			printf("Sphere %d has radius %g but radius squared %g\n",
+			       i, sc->sphereRadius[i], sc->sphereR2[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* 1 if nothing but a comment follows in text */
+static int lineEnds(const char *text){
+	text += strspn(text, " \t\r\n");
+	return *text == '\0' || *text == '#';
+}
+
+int readSceneText(FILE *file, scene *sc){
+	char *line = NULL;
+	size_t lineSize = 0;
+	int lineNumber = 0;
+	char keyword[16];
+	int used, rest;
+	sphere s;
+	material m;
+	light l;
+
+	initScene(sc);
+	while(getline(&line, &lineSize, file) != -1){
+		lineNumber++;
+		if(lineEnds(line))
+			continue;
+		sscanf(line, "%15s%n", keyword, &used);
+		rest = -1;
+		if(strcmp(keyword, "sphere") == 0){
+			sscanf(line + used, "%f %f %f %f %d%n", &s.pos.x, &s.pos.y, &s.pos.z, &s.radius, &s.material, &rest);
+			if(rest >= 0 && lineEnds(line + used + rest)){
+				addSceneSphere(sc, &s);
+				continue;
+			}
+		}else if(strcmp(keyword, "material") == 0){
+			sscanf(line + used, "%f %f %f %f%n", &m.diffuse.red, &m.diffuse.green, &m.diffuse.blue, &m.reflection, &rest);
+			if(rest >= 0 && lineEnds(line + used + rest)){
+				addSceneMaterial(sc, &m);
+				continue;
+			}
+		}else if(strcmp(keyword, "light") == 0){
+			sscanf(line + used, "%f %f %f %f %f %f%n", &l.pos.x, &l.pos.y, &l.pos.z,
+			       &l.intensity.red, &l.intensity.green, &l.intensity.blue, &rest);
+			if(rest >= 0 && lineEnds(line + used + rest)){
+				addSceneLight(sc, &l);
+				continue;
+			}
+		}
+		printf("Line %d of the scene is not a sphere, material or light: %s", lineNumber, line);
+		free(line);
+		freeScene(sc);
+		return -1;
+	}
+	free(line);
+	return 0;
+}
+
+/* Print v with the fewest digits that read back as exactly v; nine are
+ * always enough for a float */
+static void writeFloat(FILE *file, float v, char end){
+	char text[32];
+	int digits;
+	for(digits = 6; digits < 9; digits++){
+		snprintf(text, sizeof(text), "%.*g", digits, v);
+		if(strtof(text, NULL) == v)
+			break;
+	}
+	if(digits == 9)
+		snprintf(text, sizeof(text), "%.9g", v);
+	fprintf(file, "%s%c", text, end);
+}
+
+int writeSceneText(FILE *file, scene *sc){
+	int i;
+	fprintf(file, "# %d spheres, %d materials, %d lights\n", sc->numSpheres, sc->numMaterials, sc->numLights);
+	for(i = 0; i < sc->numMaterials; i++){
+		material *m = &sc->materials[i];
+		fprintf(file, "material ");
+		writeFloat(file, m->diffuse.red, ' ');
+		writeFloat(file, m->diffuse.green, ' ');
+		writeFloat(file, m->diffuse.blue, ' ');
+		writeFloat(file, m->reflection, '\n');
+	}
+	for(i = 0; i < sc->numLights; i++){
+		light *l = &sc->lights[i];
+		fprintf(file, "light ");
+		writeFloat(file, l->pos.x, ' ');
+		writeFloat(file, l->pos.y, ' ');
+		writeFloat(file, l->pos.z, ' ');
+		writeFloat(file, l->intensity.red, ' ');
+		writeFloat(file, l->intensity.green, ' ');
+		writeFloat(file, l->intensity.blue, '\n');
+	}
+	for(i = 0; i < sc->numSpheres; i++){
+		fprintf(file, "sphere ");
+		writeFloat(file, sc->sphereX[i], ' ');
+		writeFloat(file, sc->sphereY[i], ' ');
+		writeFloat(file, sc->sphereZ[i], ' ');
+		writeFloat(file, sc->sphereRadius[i], ' ');
+		fprintf(file, "%d\n", sc->sphereMaterial[i]);
+	}
+	return ferror(file) ? -1 : 0;
+}
+
+/* Where each array of a binary scene with the header's counts starts;
+ * offsets[SCENE_SECTIONS] is the size of the whole file */
+static void sceneLayout(sceneHeader *h, size_t *offsets){
+	size_t sphereBytes = roundUp((size_t) h->numSpheres, SCENE_PAD) * sizeof(float);
+	int k;
+	offsets[0] = roundUp(sizeof(sceneHeader), SCENE_ALIGN);
+	for(k = 0; k < 6; k++)
+		offsets[k + 1] = offsets[k] + sphereBytes;
+	offsets[7] = offsets[6] + roundUp(h->numMaterials * sizeof(material), SCENE_ALIGN);
+	offsets[8] = offsets[7] + roundUp(h->numLights * sizeof(light), SCENE_ALIGN);
+}
+
+int mapSceneBinary(const char *filename, scene *sc){
+	size_t offsets[SCENE_SECTIONS + 1];
+	struct stat st;
+	sceneHeader *h;
+	char *base;
+
+	initScene(sc);
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0){
+		printf("Unable to open scene file %s\n", filename);
+		return -1;
+	}
+	if(fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(sceneHeader)){
+		printf("%s is not a binary scene\n", filename);
+		close(fd);
+		return -1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED){
+		printf("Unable to map scene file %s\n", filename);
+		return -1;
+	}
+	sc->mapping = base;
+	sc->mappingSize = st.st_size;
+
+	h = (sceneHeader *) base;
+	if(memcmp(h->magic, SCENE_MAGIC, sizeof(h->magic)) != 0){
+		printf("%s is not a binary scene\n", filename);
+		freeScene(sc);
+		return -1;
+	}
+	if(h->byteOrder != SCENE_BYTE_ORDER){
+		printf("%s was written on a machine of the other byte order\n", filename);
+		freeScene(sc);
+		return -1;
+	}
+	sceneLayout(h, offsets);
+	if(h->numSpheres > INT_MAX || h->numMaterials > INT_MAX || h->numLights > INT_MAX
+	   || offsets[SCENE_SECTIONS] != (size_t) st.st_size){
+		printf("%s is truncated or damaged\n", filename);
+		freeScene(sc);
+		return -1;
+	}
+
+	/* Nothing is read here but the header; the pages of the arrays come
+	 * in as the renderer first touches them */
+	sc->numSpheres = h->numSpheres;
+	sc->numMaterials = h->numMaterials;
+	sc->numLights = h->numLights;
+	sc->sphereX = (float *) (base + offsets[0]);
+	sc->sphereY = (float *) (base + offsets[1]);
+	sc->sphereZ = (float *) (base + offsets[2]);
+	sc->sphereRadius = (float *) (base + offsets[3]);
+	sc->sphereR2 = (float *) (base + offsets[4]);
+	sc->sphereMaterial = (int *) (base + offsets[5]);
+	sc->materials = (material *) (base + offsets[6]);
+	sc->lights = (light *) (base + offsets[7]);
+	return 0;
+}
+
+/* Write bytes of data, then zeros to fill a section of sectionBytes */
+static void writeSection(FILE *file, const void *data, size_t bytes, size_t sectionBytes){
+	static const char zeros[SCENE_ALIGN];
+	if(bytes > 0)
+		fwrite(data, 1, bytes, file);
+	for(bytes = sectionBytes - bytes; bytes > 0; bytes -= bytes < sizeof(zeros) ? bytes : sizeof(zeros))
+		fwrite(zeros, 1, bytes < sizeof(zeros) ? bytes : sizeof(zeros), file);
+}
+
+int writeSceneBinary(FILE *file, scene *sc){
+	size_t offsets[SCENE_SECTIONS + 1];
+	sceneHeader h;
+	int k;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SCENE_MAGIC, sizeof(h.magic));
+	h.byteOrder = SCENE_BYTE_ORDER;
+	h.numSpheres = sc->numSpheres;
+	h.numMaterials = sc->numMaterials;
+	h.numLights = sc->numLights;
+	sceneLayout(&h, offsets);
+
+	/* Every section but the header holds one array of the scene */
+	const void *data[SCENE_SECTIONS + 1] = {&h, sc->sphereX, sc->sphereY, sc->sphereZ, sc->sphereRadius,
+	                                        sc->sphereR2, sc->sphereMaterial, sc->materials, sc->lights};
+	size_t sphereBytes = sc->numSpheres * sizeof(float);
+	size_t bytes[SCENE_SECTIONS + 1] = {sizeof(h), sphereBytes, sphereBytes, sphereBytes, sphereBytes,
+	                                    sphereBytes, sphereBytes, sc->numMaterials * sizeof(material),
+	                                    sc->numLights * sizeof(light)};
+	writeSection(file, data[0], bytes[0], offsets[0]);
+	for(k = 1; k <= SCENE_SECTIONS; k++)
+		writeSection(file, data[k], bytes[k], offsets[k] - offsets[k - 1]);
+	return ferror(file) ? -1 : 0;
+}
+
+int loadScene(const char *filename, scene *sc){
+	char magic[8];
+	FILE *file = fopen(filename, "r");
+	if(file == NULL){
+		printf("Unable to open scene file %s\n", filename);
+		return -1;
+	}
+	if(fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0){
+		fclose(file);
+		if(mapSceneBinary(filename, sc) < 0)
+			return -1;
+	}else{
+		rewind(file);
+		int result = readSceneText(file, sc);
+		fclose(file);
+		if(result < 0)
+			return -1;
+	}
+	if(checkScene(sc) < 0){
+		freeScene(sc);
+		return -1;
+	}
+	return 0;
+}
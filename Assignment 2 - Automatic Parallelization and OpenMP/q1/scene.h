@@ -0,0 +1,116 @@
+/* Scenes for the ray tracer: spheres, materials and lights, read from a
+ * text file for authoring or mapped from a binary file and used in place */
+
+#ifndef RAYTRACE_SCENE_H
+#define RAYTRACE_SCENE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* The vector structure */
+typedef struct{
+      float x,y,z;
+}vector;
+
+/* The sphere */
+typedef struct{
+        vector pos;
+        float  radius;
+	int material;
+}sphere;
+
+/* Colour */
+typedef struct{
+	float red, green, blue;
+}colour;
+
+/* Material Definition */
+typedef struct{
+	colour diffuse;
+	float reflection;
+}material;
+
+/* Lightsource definition */
+typedef struct{
+	vector pos;
+	colour intensity;
+}light;
+
+/* The spheres are kept one array per field, each aligned to SCENE_ALIGN
+ * bytes and padded with zeros to a multiple of SCENE_PAD entries, so that
+ * the ray tracer can load 8 spheres as one vector */
+#define SCENE_ALIGN 64
+#define SCENE_PAD   16
+
+typedef struct{
+	int numSpheres, numMaterials, numLights;
+	float *sphereX, *sphereY, *sphereZ;
+	float *sphereRadius;
+	float *sphereR2;	/* radius squared */
+	int *sphereMaterial;
+	material *materials;
+	light *lights;
+	int capacity;		/* spheres there is room for, while building */
+	void *mapping;		/* the binary file, if the arrays point into it */
+	size_t mappingSize;
+}scene;
+
+/*
+ * The binary form is this header followed by the arrays of the scene in
+ * order: x, y, z, radius, radius squared and material of the spheres, then
+ * the materials and the lights, each starting at a multiple of SCENE_ALIGN
+ * and padded as in memory.  Numbers are stored in the byte order of the
+ * machine that wrote the file, which byteOrder records.
+ */
+#define SCENE_MAGIC "RTSCENE1"
+#define SCENE_BYTE_ORDER 0x01020304u
+
+typedef struct{
+	char magic[8];
+	uint32_t byteOrder;
+	uint32_t numSpheres;
+	uint32_t numMaterials;
+	uint32_t numLights;
+	uint32_t reserved[10];
+}sceneHeader;
+
+/* An empty scene to add to */
+void initScene(scene *sc);
+
+/* Append to the scene; the new sphere's material need not exist yet */
+void addSceneSphere(scene *sc, sphere *s);
+void addSceneMaterial(scene *sc, material *m);
+void addSceneLight(scene *sc, light *l);
+
+/* Drop the spheres, keeping the materials and lights */
+void clearSceneSpheres(scene *sc);
+
+void freeScene(scene *sc);
+
+/* The readers and writers below return 0, or -1 with a message printed on
+ * failure */
+
+/*
+ * Text scenes hold one item per line; blank lines and lines starting with
+ * # are ignored.  Materials are numbered from 0 in the order they appear.
+ *
+ *     material <red> <green> <blue> <reflection>
+ *     light <x> <y> <z> <red> <green> <blue>
+ *     sphere <x> <y> <z> <radius> <material>
+ */
+int readSceneText(FILE *file, scene *sc);
+int writeSceneText(FILE *file, scene *sc);
+
+/* Map a binary scene read only; the scene's arrays point into the file */
+int mapSceneBinary(const char *filename, scene *sc);
+int writeSceneBinary(FILE *file, scene *sc);
+
+/* Load either form, telling them apart by the magic, and check it */
+int loadScene(const char *filename, scene *sc);
+
+/* Check that every sphere names a material, sits at a finite position and
+ * has a finite positive radius whose square matches sphereR2 */
+int checkScene(scene *sc);
+
+#endif //RAYTRACE_SCENE_H
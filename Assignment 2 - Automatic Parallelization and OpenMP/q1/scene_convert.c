@@ -0,0 +1,52 @@
+/* Convert a scene for raytrace_omp between the text and the binary form.
+ * The output takes the other form from the input unless -t or -b asks for
+ * one; either way the conversion is exact, so text -> binary -> text gives
+ * back the same numbers */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "scene.h"
+
+int main(int argc, char *argv[]){
+
+	int binary = -1;	/* form to write; -1 for the other one */
+	int c;
+	while((c = getopt(argc, argv, "tb")) != -1){
+		switch(c){
+			case 't':
+				binary = 0;
+				break;
+			case 'b':
+				binary = 1;
+				break;
+			default:
+				return 1;
+		}
+	}
+	if(argc - optind != 2){
+		printf("Usage: %s [-t | -b] input output\n", argv[0]);
+		return 1;
+	}
+
+	scene sc;
+	if(loadScene(argv[optind], &sc) < 0)
+		return 1;
+	if(binary < 0)
+		binary = sc.mapping == NULL;
+
+	FILE *output = fopen(argv[optind + 1], "w");
+	if(output == NULL){
+		printf("Unable to open output file %s\n", argv[optind + 1]);
+		return 1;
+	}
+	int result = binary ? writeSceneBinary(output, &sc) : writeSceneText(output, &sc);
+	if(fclose(output) != 0 || result < 0){
+		printf("Unable to write %s\n", argv[optind + 1]);
+		return 1;
+	}
+	printf("Wrote %d spheres, %d materials and %d lights as %s\n",
+	       sc.numSpheres, sc.numMaterials, sc.numLights, binary ? "binary" : "text");
+	freeScene(&sc);
+	return 0;
+}